@@ -0,0 +1,250 @@
+#include "../fbx.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <sys/resource.h>
+
+// Deterministic scene generator and timings of the reader, writer, find and property construction.
+// Usage: bench [--records N] [--array N] [--compression R] [--depth N] [--size MB] [--iterations N] [--output FILE]
+
+struct Options
+{
+    Options() :
+        records(10000),
+        arraySize(256),
+        compression(0.5),
+        depth(3),
+        sizeMegabytes(0.0),
+        iterations(3),
+        output("bench.fbx")
+    {}
+
+    size_t      records;
+    size_t      arraySize;
+    double      compression;
+    size_t      depth;
+    double      sizeMegabytes;
+    size_t      iterations;
+    std::string output;
+};
+
+class Random
+{
+
+public:
+
+    Random(const uint64_t seed) :
+        m_state(seed)
+    {}
+
+    uint64_t next()
+    {
+        uint64_t value = (m_state += 0x9E3779B97F4A7C15ULL);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    double unit()
+    {
+        return static_cast<double>(next() >> 11) / static_cast<double>(1ULL << 53);
+    }
+
+private:
+
+    uint64_t m_state;
+
+};
+
+// Builds Objects with chains of nested Model records, each leaf carrying a uid, a name and a float64 array.
+// The compression ratio is the share of array values drawn from a short repeating pattern.
+size_t generateScene(Fbx::Record & root, const Options & options)
+{
+    Random random(0x5EED);
+    Fbx::Record * pObjects = new Fbx::Record("Objects", &root);
+    std::vector<double> values(options.arraySize);
+    size_t records = 1;
+
+    for (size_t i = 0; i < options.records; i += options.depth)
+    {
+        Fbx::Record * pParent = pObjects;
+        for (size_t level = 0; level < options.depth && i + level < options.records; level++)
+        {
+            Fbx::Record * pRecord = new Fbx::Record(level == 0 ? "Model" : "Child", pParent);
+            pRecord->properties().insert(new Fbx::Property(static_cast<int64_t>(random.next() >> 1)));
+            pRecord->properties().insert(new Fbx::Property("Node" + std::to_string(i + level)));
+            pParent = pRecord;
+            ++records;
+        }
+
+        for (size_t j = 0; j < values.size(); j++)
+        {
+            values[j] = random.unit() < options.compression ? static_cast<double>(j % 16) : random.unit();
+        }
+        Fbx::Record * pValues = new Fbx::Record("Values", pParent);
+        pValues->properties().insert(new Fbx::Property(values.data(), static_cast<uint32_t>(values.size())));
+        ++records;
+    }
+
+    return records;
+}
+
+double seconds(const std::chrono::steady_clock::time_point & start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+long peakResidentKilobytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void report(const std::string & name, const double bestSeconds, const double bytes, const double items, const std::string & unit)
+{
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+        << std::setw(10) << std::setprecision(4) << bestSeconds << " s";
+    if (bytes > 0.0)
+    {
+        std::cout << std::setw(10) << std::setprecision(1) << bytes / bestSeconds / 1e6 << " MB/s";
+    }
+    std::cout << std::setw(16) << std::setprecision(0) << items / bestSeconds << " " << unit << "/s"
+        << std::setw(10) << peakResidentKilobytes() / 1024 << " MB peak RSS" << std::endl;
+}
+
+template<typename Function>
+double best(const size_t iterations, Function function)
+{
+    double result = 0.0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const double elapsed = seconds(start);
+        result = i == 0 ? elapsed : std::min(result, elapsed);
+    }
+    return result;
+}
+
+bool parseOptions(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char * value = argv[++i];
+
+        if (name == "--records") options.records = std::stoull(value);
+        else if (name == "--array") options.arraySize = std::stoull(value);
+        else if (name == "--compression") options.compression = std::stod(value);
+        else if (name == "--depth") options.depth = std::max<size_t>(1, std::stoull(value));
+        else if (name == "--size") options.sizeMegabytes = std::stod(value);
+        else if (name == "--iterations") options.iterations = std::max<size_t>(1, std::stoull(value));
+        else if (name == "--output") options.output = value;
+        else return false;
+    }
+
+    // Derive the record count from a target size, estimating a leaf chain at its uncompressed size.
+    if (options.sizeMegabytes > 0.0)
+    {
+        const double chainBytes = static_cast<double>(options.arraySize * 8 + options.depth * 60 + 40);
+        options.records = static_cast<size_t>(options.sizeMegabytes * 1e6 / chainBytes) * options.depth;
+    }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    if (parseOptions(argc, argv, options) == false)
+    {
+        std::cerr << "Usage: bench [--records N] [--array N] [--compression R] [--depth N] [--size MB] [--iterations N] [--output FILE]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        Fbx::Record scene;
+        const auto generateStart = std::chrono::steady_clock::now();
+        const size_t records = generateScene(scene, options);
+        report("generate", seconds(generateStart), 0.0, static_cast<double>(records), "records");
+
+        const double writeSeconds = best(options.iterations, [&]() { scene.write(options.output); });
+        std::ifstream written(options.output, std::ios::binary | std::ios::ate);
+        const double fileBytes = static_cast<double>(written.tellg());
+        report("write", writeSeconds, fileBytes, static_cast<double>(records), "records");
+
+        const double readSeconds = best(options.iterations, [&]()
+        {
+            Fbx::Record file;
+            file.read(options.output);
+        });
+        report("read", readSeconds, fileBytes, static_cast<double>(records), "records");
+
+        Fbx::Record loaded;
+        loaded.read(options.output);
+        std::cout << std::left << std::setw(12) << "memory" << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << loaded.memoryUsage() / 1e6 << " MB in the loaded tree" << std::endl;
+
+        Fbx::ReadOptions deferred;
+        deferred.deferArrays = true;
+        const double deferredSeconds = best(options.iterations, [&]()
+        {
+            Fbx::Record file;
+            file.read(options.output, deferred);
+        });
+        report("read-defer", deferredSeconds, fileBytes, static_cast<double>(records), "records");
+
+        size_t found = 0;
+        const std::string snapshotFile = options.output + ".snapshot";
+        scene.writeSnapshot(snapshotFile);
+        const double snapshotSeconds = best(options.iterations, [&]()
+        {
+            Fbx::Snapshot snapshot(snapshotFile);
+            found += snapshot.root().size();
+        });
+        report("snapshot", snapshotSeconds, fileBytes, static_cast<double>(records), "records");
+        std::remove(snapshotFile.c_str());
+
+        // Lookups of a missing name among the Objects children, the worst case of the linear search.
+        const size_t lookups = 100;
+        const double findSeconds = best(options.iterations, [&]()
+        {
+            for (size_t i = 0; i < lookups; i++)
+            {
+                const Fbx::Record * pObjects = *scene.find("Objects");
+                found += pObjects->find("Missing") == pObjects->end() ? 1 : 0;
+            }
+        });
+        report("find", findSeconds, 0.0, static_cast<double>(lookups), "lookups");
+
+        const size_t properties = 1000000;
+        const double constructSeconds = best(options.iterations, [&]()
+        {
+            const double values[4] = { 1.0, 2.0, 3.0, 4.0 };
+            for (size_t i = 0; i < properties; i += 4)
+            {
+                Fbx::Property integer(static_cast<int64_t>(i));
+                Fbx::Property number(static_cast<double>(i));
+                Fbx::Property string("Lcl Translation");
+                Fbx::Property array(values, 4);
+                found += integer.size() + number.size() + string.size() + array.size();
+            }
+        });
+        report("property", constructSeconds, 0.0, static_cast<double>(properties), "properties");
+
+        std::remove(options.output.c_str());
+        return found == 0 ? 1 : 0;
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
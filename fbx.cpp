@@ -26,575 +26,5805 @@
 #include "fbx.hpp"
 #include <memory>
 #include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
 #include <stack>
 #include <sstream>
 #include <fstream>
+#include <chrono>
 #include "miniz.h"
+#include <fcntl.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
 namespace Fbx
 {
 
-    // Helper class for reading properties.
+    // Loads paged array properties from their file offsets on access, keeping the most recently
+    // used unpinned ones inflated within a memory budget. Pinned pages are taken out of the LRU list and
+    // never evicted: leases, and the spans and value arrays holding one, pin until released. Only the raw
+    // pointer from const data() makes the page sticky until the property releases it. A page released
+    // while leased is freed by its last unpin.
+    class ArrayPager : public std::enable_shared_from_this<ArrayPager>
+    {
+
+    public:
+
+        struct Page
+        {
+            std::shared_ptr<ArrayPager> pager;
+            uint64_t                    offset;     // File offset of the stored payload.
+            uint32_t                    storedSize;
+            uint32_t                    encoding;
+            size_t                      size;       // Inflated size.
+            uint8_t *                   pData;      // Inflated array, or nullptr while evicted.
+            uint32_t                    pins;       // Pinned pages are not in the LRU list.
+            bool                        sticky;     // Pinned by the property.
+            bool                        released;   // Dropped by the property, deleted by the last unpin.
+            Page *                      pNewer;
+            Page *                      pOlder;
+        };
+
+        ArrayPager(const std::string & filename, const size_t budget, MemoryResource * resource);
+
+        Property * createProperty(const Property::Type type, const uint32_t count, const uint64_t offset,
+            const uint32_t storedSize, const uint32_t encoding);
+        size_t resident() const;
+
+        static const uint8_t * load(const Property & property);
+        static const uint8_t * pin(void * page);
+        static void unpin(void * page);
+        static void copy(const Property & property, uint8_t * output);
+        static void release(Property & property);
+
+    private:
+
+        static bool pinned(const Page * pPage);
+
+        const uint8_t * acquire(Page * pPage);
+        void unlink(Page * pPage);
+        void evict(const Page * pKeep);
+
+        std::string         m_filename;
+        std::ifstream       m_file;
+        size_t              m_budget;
+        size_t              m_resident;
+        MemoryResource *    m_pResource;
+        Page *              m_pNewest;
+        Page *              m_pOldest;
+        mutable std::mutex  m_mutex;
+
+    };
+
     namespace
     {
-        class PropertyReader
+        // Memory resource forwarding to the global heap.
+        class DefaultMemoryResource : public MemoryResource
         {
 
         public:
 
-            PropertyReader(std::ifstream & file, Record * record) :
-                m_file(file),
-                m_pRecord(record)
+            void * allocate(const size_t size, const size_t) override
+            {
+                return ::operator new(size);
+            }
+
+            void deallocate(void * pointer, const size_t, const size_t) override
+            {
+                ::operator delete(pointer);
+            }
+
+        };
+
+        // Allocations made by the library on this thread, sampled by the read and write statistics.
+        thread_local uint64_t t_allocations = 0;
+
+        // Adds the lifetime of the scope to a statistics timer, if any.
+        class ScopedTimer
+        {
+
+        public:
+
+            explicit ScopedTimer(double * pSeconds) :
+                m_pSeconds(pSeconds),
+                m_start(pSeconds != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
             {}
 
-            size_t readPrimitive(uint8_t code) const
+            ~ScopedTimer()
             {
-                switch (code)
+                if (m_pSeconds != nullptr)
                 {
-                case 'C': return readPrimitiveValue<bool>();
-                case 'Y': return readPrimitiveValue<int16_t>();
-                case 'I': return readPrimitiveValue<int32_t>();
-                case 'L': return readPrimitiveValue<int64_t>();
-                case 'F': return readPrimitiveValue<float>();
-                case 'D': return readPrimitiveValue<double>();
-                default: throw std::runtime_error("Unkown primitive property type:" + code); break;
+                    *m_pSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
                 }
-                return 0;
             }
 
-            size_t readArray(uint8_t code) const
+        private:
+
+            double *                                m_pSeconds;
+            std::chrono::steady_clock::time_point   m_start;
+
+        };
+
+        double * timer(Statistics * pStatistics, double Statistics::* seconds)
+        {
+            return pStatistics != nullptr ? &(pStatistics->*seconds) : nullptr;
+        }
+
+        // Collects the statistics of a single read or write, if requested by its options.
+        class StatisticsCollector
+        {
+
+        public:
+
+            template<typename Options>
+            explicit StatisticsCollector(const Options & options) :
+                m_pTarget(options.statistics),
+                m_hook(options.onStatistics),
+                m_allocations(t_allocations),
+                m_start(std::chrono::steady_clock::now())
+            {}
+
+            Statistics * statistics()
             {
-                uint32_t arrayLength;
-                uint32_t encoding;
-                uint32_t compressedLength;
-                m_file.read(reinterpret_cast<char*>(&arrayLength), 4);
-                m_file.read(reinterpret_cast<char*>(&encoding), 4);
-                m_file.read(reinterpret_cast<char*>(&compressedLength), 4);
+                return (m_pTarget != nullptr || m_hook) ? &m_statistics : nullptr;
+            }
 
-                if (encoding == 0)
+            // Attributes the time not spent in I/O or compression to the given phase and publishes the result.
+            void finish(double Statistics::* phase)
+            {
+                if (statistics() == nullptr)
                 {
-                    switch (code)
-                    {
-                    case 'i': return readUncompressedArray<int32_t>(arrayLength);
-                    case 'f': return readUncompressedArray<float>(arrayLength);
-                    case 'd': return readUncompressedArray<double>(arrayLength);
-                    case 'l': return readUncompressedArray<int64_t>(arrayLength);
-                    case 'b': return readUncompressedArray<bool>(arrayLength);
-                    default: throw std::runtime_error("Unkown array property type:" + code); break;
-                    }
+                    return;
                 }
-                else if (encoding == 1)
+
+                m_statistics.allocations = t_allocations - m_allocations;
+                m_statistics.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+                m_statistics.*phase = std::max(0.0, m_statistics.totalSeconds - m_statistics.ioSeconds -
+                    m_statistics.inflateSeconds - m_statistics.deflateSeconds);
+
+                if (m_pTarget != nullptr)
                 {
-                    switch (code)
-                    {
-                    case 'i': return readCompressedArray<int32_t>(arrayLength, compressedLength);
-                    case 'f': return readCompressedArray<float>(arrayLength, compressedLength);
-                    case 'd': return readCompressedArray<double>(arrayLength, compressedLength);
-                    case 'l': return readCompressedArray<int64_t>(arrayLength, compressedLength);
-                    case 'b': return readCompressedArray<bool>(arrayLength, compressedLength);
-                    default: throw std::runtime_error("Unkown array property type:" + code); break;
-                    }
+                    *m_pTarget = m_statistics;
                 }
-                else
+                if (m_hook)
                 {
-                    throw std::runtime_error("Unkown property encoding:" + std::to_string(encoding));
+                    m_hook(m_statistics);
                 }
+            }
+
+        private:
+
+            Statistics                                  m_statistics;
+            Statistics *                                m_pTarget;
+            std::function<void(const Statistics &)>     m_hook;
+            uint64_t                                    m_allocations;
+            std::chrono::steady_clock::time_point       m_start;
+
+        };
+
+#if defined(FBX_ENABLE_TRACE)
+        // Trace events recorded between startTrace and stopTrace, in the Chrome trace-event format.
+        struct TraceEvent
+        {
+            const char *    name;
+            std::string     detail;
+            int64_t         start;      // Microseconds since the trace started.
+            int64_t         duration;
+            uint32_t        thread;
+        };
+
+        std::atomic<bool>                       g_tracing(false);
+        std::mutex                              g_traceMutex;
+        std::vector<TraceEvent>                 g_traceEvents;
+        std::chrono::steady_clock::time_point   g_traceStart;
+        std::atomic<uint32_t>                   g_traceThreads(0);
+
+        int64_t traceClock()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_traceStart).count();
+        }
+
+        uint32_t traceThread()
+        {
+            thread_local const uint32_t thread = ++g_traceThreads;
+            return thread;
+        }
 
-                return 0;
+        void traceEvent(const char * name, std::string detail, const int64_t start)
+        {
+            TraceEvent event = { name, std::move(detail), start, traceClock() - start, traceThread() };
+            std::lock_guard<std::mutex> lock(g_traceMutex);
+            if (g_tracing)
+            {
+                g_traceEvents.push_back(std::move(event));
             }
+        }
+
+        class TraceScope
+        {
+
+        public:
 
-            size_t readRaw(uint8_t code) const
+            template<typename Detail>
+            TraceScope(const char * name, Detail detail) :
+                m_name(name),
+                m_start(g_tracing ? traceClock() : -1)
             {
-                uint32_t size;
-                m_file.read(reinterpret_cast<char*>(&size), 4);
-                if (size == 0)
+                if (m_start >= 0)
                 {
-                    if (code == 'S')
-                    {
-                        m_pRecord->properties().insert(new Property(std::string("")));
-                    }
-                    return 4;
+                    m_detail = detail();
                 }
+            }
 
-                std::unique_ptr<uint8_t[]> data(new uint8_t[size]);
-                m_file.read(reinterpret_cast<char*>(data.get()), size);
-
-                switch (code)
+            ~TraceScope()
+            {
+                if (m_start >= 0)
                 {
-                case 'S': m_pRecord->properties().insert(new Property(std::string(data.get(), data.get() + size))); break;
-                case 'R': m_pRecord->properties().insert(new Property(data.get(), size)); break;
-                default: throw std::runtime_error("Unkown raw property type:" + code); break;
+                    traceEvent(m_name, std::move(m_detail), m_start);
                 }
+            }
 
-                return size + 4;
+        private:
+
+            const char *    m_name;
+            int64_t         m_start;
+            std::string     m_detail;
+
+        };
+
+        // Emits a parse span for every subtree of the two levels below the root.
+        class SubtreeTracer
+        {
+
+        public:
+
+            void open()
+            {
+                m_starts.push_back(g_tracing ? traceClock() : -1);
+            }
+
+            void close(const Record * pRecord)
+            {
+                if (m_starts.empty())
+                {
+                    return;
+                }
+                const int64_t start = m_starts.back();
+                m_starts.pop_back();
+                if (start >= 0 && m_starts.size() < 2)
+                {
+                    traceEvent("parse", std::string(pRecord->name().c_str(), pRecord->name().size()), start);
+                }
             }
 
         private:
 
-            template<typename T>
-            size_t readPrimitiveValue() const
+            std::vector<int64_t> m_starts;
+
+        };
+
+        #define FBX_TRACE_SCOPE(name, detail) TraceScope fbxTraceScope(name, [&]() -> std::string { return detail; })
+#else
+        class SubtreeTracer
+        {
+
+        public:
+
+            void open()
+            {}
+
+            void close(const Record *)
+            {}
+
+        };
+
+        #define FBX_TRACE_SCOPE(name, detail)
+#endif
+
+        // Reports bytes processed out of a total, at most once per interval, and throws
+        // OperationCanceled as soon as the callback returns false.
+        class ProgressReporter
+        {
+
+        public:
+
+            template<typename Options>
+            ProgressReporter(const Options & options, const uint64_t total) :
+                m_function(options.onProgress),
+                m_interval(std::max<uint64_t>(options.progressInterval, 1)),
+                m_total(total),
+                m_reported(0)
+            {}
+
+            bool enabled() const
             {
-                T val;
-                m_file.read(reinterpret_cast<char*>(&val), sizeof(T));
-                m_pRecord->properties().insert(new Property(val));
-                return sizeof(T);
+                return static_cast<bool>(m_function);
             }
 
-            template<typename T>
-            size_t readUncompressedArray(uint32_t arrayLength) const
+            void update(const uint64_t processed)
+            {
+                if (m_function && processed - m_reported >= m_interval)
+                {
+                    report(processed);
+                }
+            }
+
+            void finish()
             {
-                size_t size = arrayLength * sizeof(T);
-                std::unique_ptr<T[]> data(new T[size]);
-                m_file.read(reinterpret_cast<char*>(data.get()), size);
-                m_pRecord->properties().insert(new Property(data.get(), arrayLength));
-                return size + 12;
+                if (m_function)
+                {
+                    report(m_total);
+                }
             }
 
-            template<typename T>
-            size_t readCompressedArray(uint32_t arrayLength, uint32_t compressedLength) const
+        private:
+
+            void report(const uint64_t processed)
             {
-                mz_ulong uncompressedLength = arrayLength * sizeof(T);
-                std::unique_ptr<T[]> pArray(new T[arrayLength]);
-                std::unique_ptr<unsigned char[]> pCmpData(new unsigned char[compressedLength]);
+                m_reported = processed;
+                if (m_function(processed, m_total) == false)
+                {
+                    throw OperationCanceled();
+                }
+            }
+
+            std::function<bool(uint64_t, uint64_t)>     m_function;
+            uint64_t                                    m_interval;
+            uint64_t                                    m_total;
+            uint64_t                                    m_reported;
+
+        };
+
+        // Erases the children appended to a record since construction, unless dismissed.
+        class AppendedRecordsGuard
+        {
+
+        public:
+
+            explicit AppendedRecordsGuard(Record & record) :
+                m_record(record),
+                m_size(record.size()),
+                m_dismissed(false)
+            {}
 
-                m_file.read(reinterpret_cast<char*>(pCmpData.get()), compressedLength);
-                if (uncompress(reinterpret_cast<unsigned char*>(pArray.get()), &uncompressedLength, pCmpData.get(), compressedLength) != Z_OK)
+            ~AppendedRecordsGuard()
+            {
+                while (m_dismissed == false && m_record.size() > m_size)
                 {
-                    throw std::runtime_error("Failed to uncompress array of record: " + m_pRecord->name());
+                    m_record.erase(--m_record.end());
                 }
+            }
 
-                m_pRecord->properties().insert(new Property(pArray.get(), arrayLength));
-                return compressedLength + 12;
+            void dismiss()
+            {
+                m_dismissed = true;
             }
 
-            std::ifstream & m_file;
-            Record *        m_pRecord;
+        private:
+
+            Record &    m_record;
+            size_t      m_size;
+            bool        m_dismissed;
 
         };
 
-        template<typename T>
-        void writePrimitive(std::vector<uint8_t> & data, T value)
+        // Records and properties are prefixed by a header holding their memory resource,
+        // making it possible to delete them without knowing where they came from.
+        const size_t objectHeaderSize = alignof(std::max_align_t);
+
+        void * allocateObject(const size_t size, MemoryResource * resource)
+        {
+            if (resource == nullptr)
+            {
+                resource = MemoryResource::defaultResource();
+            }
+
+            ++t_allocations;
+            uint8_t * pMemory = static_cast<uint8_t *>(resource->allocate(size + objectHeaderSize, alignof(std::max_align_t)));
+            *reinterpret_cast<MemoryResource **>(pMemory) = resource;
+            return pMemory + objectHeaderSize;
+        }
+
+        void deallocateObject(void * pointer, const size_t size)
         {
-            const uint8_t * pValue = reinterpret_cast<const uint8_t*>(&value);
-            data.insert(data.end(), pValue, pValue + sizeof(T));
+            if (pointer == nullptr)
+            {
+                return;
+            }
+
+            uint8_t * pMemory = static_cast<uint8_t *>(pointer) - objectHeaderSize;
+            MemoryResource * resource = *reinterpret_cast<MemoryResource **>(pMemory);
+            resource->deallocate(pMemory, size + objectHeaderSize, alignof(std::max_align_t));
         }
 
-        void writeRaw(std::vector<uint8_t> & data, const std::vector<uint8_t> & raw)
+        // splitmix64 finalizer, used for the open-addressing UID tables.
+        uint64_t hashUid(const int64_t uid)
         {
-            const uint32_t size = static_cast<uint32_t>(raw.size());
-            const uint8_t * pSize = reinterpret_cast<const uint8_t*>(&size);
-            data.insert(data.end(), pSize, pSize + 4);
-            std::copy(raw.begin(), raw.end(), std::back_inserter(data));
+            uint64_t hash = static_cast<uint64_t>(uid) + 0x9E3779B97F4A7C15ULL;
+            hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+            return hash ^ (hash >> 31);
         }
 
-        template<typename T>
-        void writeArray(std::vector<uint8_t> & data, const std::vector<Property::Value> & array)
+        // Smallest power of two table size keeping the load factor at or below 0.5.
+        size_t hashCapacity(const size_t count)
         {
-            const uint32_t arrayLength = static_cast<uint32_t>(array.size());
-            const uint32_t arraySize = arrayLength * sizeof(T);
-            const uint8_t * pArrayLength = reinterpret_cast<const uint8_t*>(&arrayLength);
- 
-            data.insert(data.end(), pArrayLength, pArrayLength + 4);
-            data.insert(data.end(), 4, 0);
-            data.insert(data.end(), 4, 0);
+            size_t capacity = 16;
+            while (capacity < count * 2)
+            {
+                capacity *= 2;
+            }
+            return capacity;
+        }
 
-            if (arraySize != 0)
+        // Process wide pool of interned property names. Lookups probe an open addressed table of
+        // published nodes without locking; inserts take the mutex and publish each node with a release
+        // store. Grown tables replace the current one, and the old ones are kept for readers still probing them.
+        class NamePool
+        {
+
+        public:
+
+            static NamePool & instance()
+            {
+                static NamePool pool;
+                return pool;
+            }
+
+            uint32_t intern(const std::string & name)
+            {
+                return intern(name.data(), name.size());
+            }
+
+            uint32_t intern(const char * name, const size_t size)
             {
-                std::vector<uint8_t> * pBytes = new std::vector<uint8_t>();
-                for (uint32_t i = 0; i < arrayLength; i++)
+                const uint64_t hash = hashName(name, size);
+                const Node * pNode = lookup(*m_pTable.load(std::memory_order_acquire), hash, name, size);
+                if (pNode != nullptr)
                 {
-                    const uint8_t * pValue = reinterpret_cast<const uint8_t*> (&array[i].boolean);
-                    pBytes->insert(pBytes->end(), pValue, pValue + sizeof(T));
+                    return pNode->id;
                 }
 
-                uint32_t compressedLength = static_cast<uint32_t>(pBytes->size());
-                uint32_t encoding = 0;
-                if (arraySize > 127)
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Table * pTable = m_pTable.load(std::memory_order_relaxed);
+                pNode = lookup(*pTable, hash, name, size);
+                if (pNode != nullptr)
                 {
-                    std::vector<uint8_t> * pCompressedBytes = new std::vector<uint8_t>(pBytes->begin(), pBytes->end());
+                    return pNode->id;
+                }
 
-                    mz_ulong destLength = static_cast<mz_ulong>(pBytes->size());
-                    int status = 0;
-                    if ((status = compress(&(*pCompressedBytes)[0], &destLength, &(*pBytes)[0], destLength)) == MZ_OK)
+                if ((m_nodes.size() + 1) * 2 > pTable->mask + 1)
+                {
+                    m_tables.emplace_back(new Table((pTable->mask + 1) * 2));
+                    pTable = m_tables.back().get();
+                    for (const Node & node : m_nodes)
                     {
-                        delete pBytes;
-                        pBytes = pCompressedBytes;
-                        compressedLength = static_cast<uint32_t>(destLength);
-                        encoding = 1;
+                        insert(*pTable, &node);
                     }
-                    else
+                    m_pTable.store(pTable, std::memory_order_release);
+                }
+
+                m_nodes.push_back(Node{ std::string(name, size), hash, static_cast<uint32_t>(m_nodes.size()) });
+                insert(*pTable, &m_nodes.back());
+                return m_nodes.back().id;
+            }
+
+            bool find(const std::string & name, uint32_t & id) const
+            {
+                const Node * pNode = lookup(*m_pTable.load(std::memory_order_acquire), hashName(name.data(), name.size()), name.data(), name.size());
+                if (pNode == nullptr)
+                {
+                    return false;
+                }
+                id = pNode->id;
+                return true;
+            }
+
+        private:
+
+            struct Node
+            {
+                std::string     name;
+                uint64_t        hash;
+                uint32_t        id;
+            };
+
+            struct Table
+            {
+                explicit Table(const size_t capacity) :
+                    mask(capacity - 1),
+                    pSlots(new std::atomic<const Node *>[capacity]())
+                {}
+
+                size_t                                          mask;
+                std::unique_ptr<std::atomic<const Node *>[]>    pSlots;
+            };
+
+            NamePool()
+            {
+                m_tables.emplace_back(new Table(1024));
+                m_pTable.store(m_tables.back().get(), std::memory_order_release);
+            }
+
+            static uint64_t hashName(const char * name, const size_t size)
+            {
+                uint64_t hash = 0xCBF29CE484222325ULL;
+                for (size_t i = 0; i < size; i++)
+                {
+                    hash = (hash ^ static_cast<uint8_t>(name[i])) * 0x100000001B3ULL;
+                }
+                return hash;
+            }
+
+            static const Node * lookup(const Table & table, const uint64_t hash, const char * name, const size_t size)
+            {
+                for (size_t index = static_cast<size_t>(hash) & table.mask; ; index = (index + 1) & table.mask)
+                {
+                    const Node * pNode = table.pSlots[index].load(std::memory_order_acquire);
+                    if (pNode == nullptr)
+                    {
+                        return nullptr;
+                    }
+                    if (pNode->hash == hash && pNode->name.size() == size && memcmp(pNode->name.data(), name, size) == 0)
+                    {
+                        return pNode;
+                    }
+                }
+            }
+
+            static void insert(Table & table, const Node * pNode)
+            {
+                size_t index = static_cast<size_t>(pNode->hash) & table.mask;
+                while (table.pSlots[index].load(std::memory_order_relaxed) != nullptr)
+                {
+                    index = (index + 1) & table.mask;
+                }
+                table.pSlots[index].store(pNode, std::memory_order_release);
+            }
+
+            std::mutex                          m_mutex;
+            std::deque<Node>                    m_nodes;
+            std::vector<std::unique_ptr<Table>> m_tables;
+            std::atomic<Table *>                m_pTable;
+
+        };
+
+        // Runs function over [0, count) split into contiguous chunks of at least grain items,
+        // one chunk per thread. The calling thread runs the first chunk.
+        void parallelFor(const size_t count, const size_t grain, unsigned int threads, const std::function<void(size_t, size_t)> & function)
+        {
+            if (threads == 0)
+            {
+                threads = std::max(1U, std::thread::hardware_concurrency());
+            }
+
+            const size_t chunks = std::min<size_t>(threads, (count + grain - 1) / std::max<size_t>(grain, 1));
+            if (chunks <= 1)
+            {
+                if (count)
+                {
+                    function(0, count);
+                }
+                return;
+            }
+
+            FBX_TRACE_SCOPE("parallelFor", std::to_string(count) + " items in " + std::to_string(chunks) + " chunks");
+            const size_t chunkSize = (count + chunks - 1) / chunks;
+            std::exception_ptr error;
+            std::mutex errorMutex;
+            auto runChunk = [&](const size_t chunk)
+            {
+                try
+                {
+                    const size_t begin = chunk * chunkSize;
+                    const size_t end = std::min(count, begin + chunkSize);
+                    if (begin < end)
                     {
-                        delete pCompressedBytes;
+                        FBX_TRACE_SCOPE("task", std::to_string(begin) + "-" + std::to_string(end));
+                        function(begin, end);
                     }
                 }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    error = std::current_exception();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(chunks - 1);
+            for (size_t i = 1; i < chunks; i++)
+            {
+                workers.emplace_back(runChunk, i);
+            }
+            runChunk(0);
+            for (auto & worker : workers)
+            {
+                worker.join();
+            }
 
-                const uint8_t * pCompressedLength = reinterpret_cast<const uint8_t*>(&compressedLength);
-                const uint8_t * pArrayLength = reinterpret_cast<const uint8_t*>(&arrayLength);
-                const uint8_t * pEncoding = reinterpret_cast<const uint8_t*>(&encoding);
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        bool nameEquals(const String & name, const std::string & other)
+        {
+            return name.size() == other.size() && name.compare(0, name.size(), other.c_str(), other.size()) == 0;
+        }
+
+        // Code and element size of every property type, indexed by Property::Type.
+        struct TypeInfo
+        {
+            uint8_t code;
+            uint8_t elementSize;
+        };
+
+        const TypeInfo typeInfos[] =
+        {
+            { PropertyTraits<bool>::code, sizeof(bool) },
+            { PropertyTraits<int16_t>::code, sizeof(int16_t) },
+            { PropertyTraits<int32_t>::code, sizeof(int32_t) },
+            { PropertyTraits<int64_t>::code, sizeof(int64_t) },
+            { PropertyTraits<float>::code, sizeof(float) },
+            { PropertyTraits<double>::code, sizeof(double) },
+            { PropertyTraits<bool>::arrayCode, sizeof(bool) },
+            { PropertyTraits<int32_t>::arrayCode, sizeof(int32_t) },
+            { PropertyTraits<int64_t>::arrayCode, sizeof(int64_t) },
+            { PropertyTraits<float>::arrayCode, sizeof(float) },
+            { PropertyTraits<double>::arrayCode, sizeof(double) },
+            { 'S', 1 },
+            { 'R', 1 }
+        };
+
+        const size_t typeCount = sizeof(typeInfos) / sizeof(TypeInfo);
+
+        // Size in bytes of a primitive, or of a single element of an array, string or raw property.
+        size_t elementSize(const Property::Type type)
+        {
+            return typeInfos[static_cast<size_t>(type)].elementSize;
+        }
+
+        // Text of a property, shared by Property and PropertyView.
+        std::string propertyString(const Property::Type type, const Property::Value & value, const uint8_t * data, const uint32_t size)
+        {
+            switch (type)
+            {
+                case Property::Type::Boolean: return value.boolean ? "true" : "false";
+                case Property::Type::Integer16: return std::to_string(value.integer16);
+                case Property::Type::Integer32: return std::to_string(value.integer32);
+                case Property::Type::Integer64: return std::to_string(value.integer64);
+                case Property::Type::Float32: return std::to_string(value.float32);
+                case Property::Type::Float64: return std::to_string(value.float64);
+                case Property::Type::BooleanArray: return "array(boolean)";
+                case Property::Type::Integer32Array: return "array(integer32)";
+                case Property::Type::Integer64Array: return "array(integer64)";
+                case Property::Type::Float32Array: return "array(float32)";
+                case Property::Type::Float64Array: return "array(float64)";
+                case Property::Type::String:
+                case Property::Type::Raw: return std::string(data, data + size);
+                default: break;
+            }
+
+            return "";
+        }
+
+        // Reverse lookup table of typeInfos, mapping property codes to types.
+        class CodeTable
+        {
+
+        public:
+
+            CodeTable()
+            {
+                memset(m_types, 0xFF, sizeof(m_types));
+                for (size_t i = 0; i < typeCount; i++)
+                {
+                    m_types[typeInfos[i].code] = static_cast<uint8_t>(i);
+                }
+            }
+
+            bool find(const uint8_t code, Property::Type & type) const
+            {
+                if (m_types[code] == 0xFF)
+                {
+                    return false;
+                }
+                type = static_cast<Property::Type>(m_types[code]);
+                return true;
+            }
+
+        private:
+
+            uint8_t m_types[256];
+
+        };
+
+        Property::Type typeFromCode(const uint8_t code)
+        {
+            static const CodeTable table;
+
+            Property::Type type;
+            if (table.find(code, type) == false)
+            {
+                throw std::runtime_error("Unkown property type: " + std::to_string(code));
+            }
+            return type;
+        }
+
+        // Smallest inflated size of arrays left in the file by memory budgeted reads.
+        const size_t pagedArraySize = 4096;
+
+        // Helper class for reading properties.
+        class PropertyReader
+        {
+
+        public:
+
+            PropertyReader(std::istream & file, Record * record, const bool deferArrays, ArrayPager * pager, Statistics * statistics) :
+                m_file(file),
+                m_pRecord(record),
+                m_deferArrays(deferArrays),
+                m_pPager(pager),
+                m_pStatistics(statistics)
+            {}
+
+            size_t read(const uint8_t code) const
+            {
+                if (m_pStatistics != nullptr)
+                {
+                    ++m_pStatistics->properties;
+                }
+
+                const Property::Type type = typeFromCode(code);
+                if (type <= Property::Type::Float64)
+                {
+                    return readPrimitive(type);
+                }
+                else if (type <= Property::Type::Float64Array)
+                {
+                    return readArray(type);
+                }
+                return readRaw(type);
+            }
+
+        private:
+
+            size_t readPrimitive(const Property::Type type) const
+            {
+                std::unique_ptr<Property> pProperty(createProperty(type, 0));
+                const size_t size = elementSize(type);
+                readBytes(pProperty->data(), size);
+                m_pRecord->properties().insert(pProperty.release());
+                return size;
+            }
+
+            size_t readArray(const Property::Type type) const
+            {
+                uint32_t arrayLength;
+                uint32_t encoding;
+                uint32_t compressedLength;
+                readBytes(&arrayLength, 4);
+                readBytes(&encoding, 4);
+                readBytes(&compressedLength, 4);
+
+                if (encoding != 0 && encoding != 1)
+                {
+                    throw std::runtime_error("Unkown property encoding:" + std::to_string(encoding));
+                }
+
+                const size_t size = static_cast<size_t>(arrayLength) * elementSize(type);
+                if (encoding == 0 && size != compressedLength)
+                {
+                    throw std::runtime_error(std::string("Invalid array length of record: ") + m_pRecord->name().c_str());
+                }
+
+                // Leave large arrays in the file, to be loaded on access.
+                if (m_pPager != nullptr && size >= pagedArraySize)
+                {
+                    const uint64_t offset = static_cast<uint64_t>(m_file.tellg());
+                    m_file.seekg(compressedLength, std::ios::cur);
+                    m_pRecord->properties().insert(m_pPager->createProperty(type, arrayLength, offset, compressedLength, encoding));
+                    return compressedLength + 12;
+                }
+
+                if (encoding == 1 && m_deferArrays)
+                {
+                    MemoryResource * resource = m_pRecord->resource();
+                    std::unique_ptr<Property> pProperty(new (resource) Property(type, arrayLength, nullptr, compressedLength, resource));
+                    readBytes(pProperty->encoded().data(), compressedLength);
+                    if (m_pStatistics != nullptr)
+                    {
+                        m_pStatistics->compressedBytes += compressedLength;
+                    }
+                    m_pRecord->properties().insert(pProperty.release());
+                    return compressedLength + 12;
+                }
+
+                std::unique_ptr<Property> pProperty(createProperty(type, arrayLength));
+                unsigned char * pArray = reinterpret_cast<unsigned char *>(pProperty->data());
+
+                if (encoding == 0)
+                {
+                    readBytes(pArray, size);
+                }
+                else
+                {
+                    mz_ulong uncompressedLength = static_cast<mz_ulong>(size);
+                    ++t_allocations;
+                    std::unique_ptr<unsigned char[]> pCmpData(new unsigned char[compressedLength]);
+
+                    readBytes(pCmpData.get(), compressedLength);
+                    FBX_TRACE_SCOPE("inflate", std::string(m_pRecord->name().c_str()) + " " + std::to_string(size) + " bytes");
+                    ScopedTimer inflateTimer(timer(m_pStatistics, &Statistics::inflateSeconds));
+                    if (uncompress(pArray, &uncompressedLength, pCmpData.get(), compressedLength) != Z_OK ||
+                        uncompressedLength != size)
+                    {
+                        throw std::runtime_error(std::string("Failed to uncompress array of record: ") + m_pRecord->name().c_str());
+                    }
+                    if (m_pStatistics != nullptr)
+                    {
+                        m_pStatistics->compressedBytes += compressedLength;
+                        m_pStatistics->decompressedBytes += size;
+                    }
+                }
+
+                m_pRecord->properties().insert(pProperty.release());
+                return compressedLength + 12;
+            }
+
+            size_t readRaw(const Property::Type type) const
+            {
+                uint32_t size;
+                readBytes(&size, 4);
+
+                std::unique_ptr<Property> pProperty(createProperty(type, size));
+                if (size)
+                {
+                    readBytes(pProperty->data(), size);
+                }
+
+                m_pRecord->properties().insert(pProperty.release());
+                return size + 4;
+            }
+
+            Property * createProperty(const Property::Type type, const uint32_t size) const
+            {
+                MemoryResource * resource = m_pRecord->resource();
+                return new (resource) Property(type, size, resource);
+            }
+
+            void readBytes(void * data, const size_t size) const
+            {
+                ScopedTimer ioTimer(timer(m_pStatistics, &Statistics::ioSeconds));
+                m_file.read(static_cast<char*>(data), size);
+            }
+
+            std::istream &  m_file;
+            Record *        m_pRecord;
+            bool            m_deferArrays;
+            ArrayPager *    m_pPager;
+            Statistics *    m_pStatistics;
+
+        };
+
+        // Header of a single property, as seen by the structure scanner.
+        struct PropertyHeader
+        {
+            Property::Type  type;
+            uint64_t        offset;     // File offset of the payload.
+            uint32_t        size;       // Size of the payload in the file.
+            uint32_t        length;     // Array length, or byte count of strings and raw data.
+            uint32_t        encoding;
+        };
+
+        // Walks the record structure of a file, validating record and property headers
+        // without reading any payloads. Memory usage only depends on the nesting depth.
+        class StructureScanner
+        {
+
+        public:
+
+            StructureScanner(std::istream & file) :
+                m_file(file),
+                m_fileSize(0)
+            {}
+
+            uint32_t readHeader()
+            {
+                m_file.seekg(0, std::ios::end);
+                const std::streampos streamPos = m_file.tellg();
+                if (streamPos > static_cast<std::streampos>(std::numeric_limits<uint32_t>::max()))
+                {
+                    throw std::runtime_error("Input file size is too big.");
+                }
+                m_fileSize = static_cast<uint64_t>(streamPos);
+                m_file.seekg(0, std::ios::beg);
+
+                const char expectedMagic[23] = "Kaydara FBX Binary  \0\x1A";
+                char magic[23];
+                uint32_t version = 0;
+                m_file.read(magic, 23);
+                m_file.read(reinterpret_cast<char*>(&version), 4);
+
+                if (m_file.good() == false || memcmp(magic, expectedMagic, 23) != 0)
+                {
+                    throw std::runtime_error("Invalid FBX file.");
+                }
+                return version;
+            }
+
+            template<typename RecordFunction, typename PropertyFunction>
+            void scan(RecordFunction onRecord, PropertyFunction onProperty)
+            {
+                std::vector<uint64_t> endStack;
+                endStack.push_back(m_fileSize);
+
+                while (endStack.size())
+                {
+                    const uint64_t recordPos = position();
+                    uint32_t endOffset = 0;
+                    uint32_t numProperties = 0;
+                    uint32_t propertyListLen = 0;
+                    uint8_t nameLen = 0;
+                    char name[256];
+
+                    read(&endOffset, 4);
+                    read(&numProperties, 4);
+                    read(&propertyListLen, 4);
+                    read(&nameLen, 1);
+                    read(name, nameLen);
+
+                    const uint64_t parentEndOffset = endStack.back();
+                    if (endOffset == 0) // End of nested list.
+                    {
+                        if (numProperties != 0 || propertyListLen != 0 || nameLen != 0)
+                        {
+                            throw std::runtime_error("Invalid nested list end record.");
+                        }
+                        if (endStack.size() > 1 && position() != parentEndOffset)
+                        {
+                            throw std::runtime_error("Nested list end not matching record end offset.");
+                        }
+                        endStack.pop_back();
+                        continue;
+                    }
+
+                    if (endOffset > m_fileSize)
+                    {
+                        throw std::runtime_error("Record end offset exceeding file size.");
+                    }
+                    if (endOffset >= parentEndOffset)
+                    {
+                        throw std::runtime_error("Record end offset exceeding parent record.");
+                    }
+
+                    const uint64_t propertiesPos = position();
+                    if (propertiesPos + propertyListLen > endOffset)
+                    {
+                        throw std::runtime_error("Invalid record property list length.");
+                    }
+
+                    onRecord(std::string(name, name + nameLen), endStack.size() - 1, recordPos);
+
+                    for (uint32_t i = 0; i < numProperties; ++i)
+                    {
+                        const PropertyHeader header = readPropertyHeader(propertiesPos + propertyListLen);
+                        onProperty(header);
+                        m_file.seekg(static_cast<std::streamoff>(header.offset + header.size));
+                    }
+
+                    if (position() != propertiesPos + propertyListLen)
+                    {
+                        throw std::runtime_error("Invalid property list length of record: " + std::string(name, name + nameLen));
+                    }
+
+                    if (position() != endOffset)
+                    {
+                        endStack.push_back(endOffset);
+                    }
+                }
+            }
+
+        private:
+
+            PropertyHeader readPropertyHeader(const uint64_t propertiesEnd)
+            {
+                uint8_t code = 0;
+                read(&code, 1);
+
+                PropertyHeader header;
+                header.type = typeFromCode(code);
+                header.encoding = 0;
+
+                if (header.type <= Property::Type::Float64)
+                {
+                    header.length = 1;
+                    header.size = static_cast<uint32_t>(elementSize(header.type));
+                }
+                else if (header.type <= Property::Type::Float64Array)
+                {
+                    uint32_t compressedLength = 0;
+                    read(&header.length, 4);
+                    read(&header.encoding, 4);
+                    read(&compressedLength, 4);
+
+                    if (header.encoding > 1)
+                    {
+                        throw std::runtime_error("Unkown property encoding:" + std::to_string(header.encoding));
+                    }
+                    const uint64_t arraySize = static_cast<uint64_t>(header.length) * elementSize(header.type);
+                    if (header.encoding == 0 && compressedLength != arraySize)
+                    {
+                        throw std::runtime_error("Invalid array length.");
+                    }
+                    header.size = compressedLength;
+                }
+                else
+                {
+                    read(&header.length, 4);
+                    header.size = header.length;
+                }
+
+                header.offset = position();
+                if (header.offset + header.size > propertiesEnd)
+                {
+                    throw std::runtime_error("Property exceeding property list length.");
+                }
+                return header;
+            }
+
+            void read(void * data, const size_t size)
+            {
+                m_file.read(reinterpret_cast<char*>(data), size);
+                if (m_file.good() == false)
+                {
+                    throw std::runtime_error("Unexpected end of file.");
+                }
+            }
+
+            uint64_t position()
+            {
+                return static_cast<uint64_t>(m_file.tellg());
+            }
+
+            std::istream &  m_file;
+            uint64_t        m_fileSize;
+
+        };
+
+        // Inflates a compressed array in fixed size chunks, letting miniz verify the adler32 checksum.
+        void verifyCompressedArray(std::istream & file, const PropertyHeader & header)
+        {
+            const size_t chunkSize = 64 * 1024;
+            std::unique_ptr<unsigned char[]> pInput(new unsigned char[chunkSize]);
+            std::unique_ptr<unsigned char[]> pOutput(new unsigned char[chunkSize]);
+
+            mz_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            if (mz_inflateInit(&stream) != MZ_OK)
+            {
+                throw std::runtime_error("Failed to initialize inflate.");
+            }
+
+            const uint64_t expectedSize = static_cast<uint64_t>(header.length) * elementSize(header.type);
+            uint32_t remaining = header.size;
+            uint64_t totalOut = 0;
+            int status = MZ_OK;
+            file.seekg(static_cast<std::streamoff>(header.offset));
+
+            do
+            {
+                if (stream.avail_in == 0 && remaining != 0)
+                {
+                    const uint32_t readSize = static_cast<uint32_t>(std::min<size_t>(remaining, chunkSize));
+                    file.read(reinterpret_cast<char*>(pInput.get()), readSize);
+                    remaining -= readSize;
+                    stream.next_in = pInput.get();
+                    stream.avail_in = readSize;
+                }
+
+                stream.next_out = pOutput.get();
+                stream.avail_out = chunkSize;
+                status = mz_inflate(&stream, MZ_NO_FLUSH);
+                totalOut += chunkSize - stream.avail_out;
+
+                if ((status == MZ_BUF_ERROR && remaining == 0 && stream.avail_in == 0) || totalOut > expectedSize)
+                {
+                    break;
+                }
+            } while (status == MZ_OK || status == MZ_BUF_ERROR);
+            mz_inflateEnd(&stream);
+
+            if (status != MZ_STREAM_END || totalOut != expectedSize)
+            {
+                throw std::runtime_error("Invalid compressed array data.");
+            }
+        }
+
+        // Pulls fixed size pieces out of a zlib stream held in memory.
+        class ArrayInflater
+        {
+
+        public:
+
+            ArrayInflater(const Span<const uint8_t> & input)
+            {
+                memset(&m_stream, 0, sizeof(m_stream));
+                if (mz_inflateInit(&m_stream) != MZ_OK)
+                {
+                    throw std::runtime_error("Failed to initialize inflate.");
+                }
+                m_stream.next_in = input.data();
+                m_stream.avail_in = static_cast<unsigned int>(input.size());
+            }
+
+            ~ArrayInflater()
+            {
+                mz_inflateEnd(&m_stream);
+            }
+
+            void read(uint8_t * output, const size_t size)
+            {
+                m_stream.next_out = output;
+                m_stream.avail_out = static_cast<unsigned int>(size);
+                while (m_stream.avail_out)
+                {
+                    const int status = mz_inflate(&m_stream, MZ_SYNC_FLUSH);
+                    if (status == MZ_STREAM_END && m_stream.avail_out)
+                    {
+                        throw std::runtime_error("Compressed array is shorter than its length.");
+                    }
+                    if (status != MZ_OK && status != MZ_STREAM_END)
+                    {
+                        throw std::runtime_error("Invalid compressed array data.");
+                    }
+                }
+            }
+
+            void finish()
+            {
+                uint8_t extra;
+                m_stream.next_out = &extra;
+                m_stream.avail_out = 1;
+                if (mz_inflate(&m_stream, MZ_FINISH) != MZ_STREAM_END || m_stream.avail_out == 0)
+                {
+                    throw std::runtime_error("Compressed array is longer than its length.");
+                }
+            }
+
+        private:
+
+            mz_stream m_stream;
+
+        };
+
+        // Narrows float arrays into a caller buffer, tracking per component bounds.
+        // Conversion and bounds are separate loops over contiguous data so they vectorize.
+        class FloatConverter
+        {
+
+        public:
+
+            FloatConverter(float * output, const size_t components, const bool bounds) :
+                m_pOutput(output),
+                m_components(components),
+                m_count(0)
+            {
+                if (bounds)
+                {
+                    m_minimum.resize(components, std::numeric_limits<float>::infinity());
+                    m_maximum.resize(components, -std::numeric_limits<float>::infinity());
+                }
+            }
+
+            template<typename T>
+            void convert(const T * input, const size_t count)
+            {
+                float * pOutput = m_pOutput;
+                for (size_t i = 0; i < count; i++)
+                {
+                    pOutput[i] = static_cast<float>(input[i]);
+                }
+                m_pOutput += count;
+                m_count += count;
+
+                // Chunks always hold whole tuples, so component c starts at offset c.
+                for (size_t c = 0; c < m_minimum.size(); c++)
+                {
+                    float minimum = m_minimum[c];
+                    float maximum = m_maximum[c];
+                    for (size_t i = c; i < count; i += m_components)
+                    {
+                        minimum = std::min(minimum, pOutput[i]);
+                        maximum = std::max(maximum, pOutput[i]);
+                    }
+                    m_minimum[c] = minimum;
+                    m_maximum[c] = maximum;
+                }
+            }
+
+            void bounds(float * minimum, float * maximum) const
+            {
+                if (m_count == 0)
+                {
+                    return;
+                }
+                if (minimum != nullptr)
+                {
+                    std::copy(m_minimum.begin(), m_minimum.end(), minimum);
+                }
+                if (maximum != nullptr)
+                {
+                    std::copy(m_maximum.begin(), m_maximum.end(), maximum);
+                }
+            }
+
+        private:
+
+            float *             m_pOutput;
+            size_t              m_components;
+            size_t              m_count;
+            std::vector<float>  m_minimum;
+            std::vector<float>  m_maximum;
+
+        };
+
+        void writePrimitive(std::vector<uint8_t> & data, const Property & property)
+        {
+            const uint8_t * pValue = static_cast<const uint8_t*>(property.data());
+            data.insert(data.end(), pValue, pValue + property.size());
+        }
+
+        void writeRaw(std::vector<uint8_t> & data, const Span<const uint8_t> & raw)
+        {
+            const uint32_t size = static_cast<uint32_t>(raw.size());
+            const uint8_t * pSize = reinterpret_cast<const uint8_t*>(&size);
+            data.insert(data.end(), pSize, pSize + 4);
+            data.insert(data.end(), raw.begin(), raw.end());
+        }
+
+        // Writes an array still holding its compressed payload without recompressing it.
+        void writeEncodedArray(std::vector<uint8_t> & data, const Property & property, Statistics * pStatistics)
+        {
+            const Span<const uint8_t> payload = property.encoded();
+            if (pStatistics != nullptr)
+            {
+                pStatistics->compressedBytes += payload.size();
+                pStatistics->decompressedBytes += static_cast<uint64_t>(property.size()) * elementSize(property.type());
+            }
+            const uint32_t header[3] = { property.size(), 1, static_cast<uint32_t>(payload.size()) };
+            const uint8_t * pHeader = reinterpret_cast<const uint8_t*>(header);
+            data.insert(data.end(), pHeader, pHeader + 12);
+            data.insert(data.end(), payload.begin(), payload.end());
+        }
+
+        void writeArray(std::vector<uint8_t> & data, const Property::ValueArray & array, Statistics * pStatistics)
+        {
+            const uint32_t arrayLength = array.size();
+            const uint32_t arraySize = arrayLength * static_cast<uint32_t>(elementSize(array.type()));
+            const uint8_t * pArrayLength = reinterpret_cast<const uint8_t*>(&arrayLength);
+
+            data.insert(data.end(), pArrayLength, pArrayLength + 4);
+            const size_t headerPos = data.size();
+            data.insert(data.end(), 8, 0);
+
+            if (arraySize == 0)
+            {
+                return;
+            }
+
+            // Compress straight into the output buffer, falling back to raw bytes if it doesn't pay off.
+            uint32_t compressedLength = arraySize;
+            uint32_t encoding = 0;
+            const size_t dataPos = data.size();
+            if (arraySize > 127)
+            {
+                mz_ulong destLength = mz_compressBound(arraySize);
+                data.resize(dataPos + destLength);
+                FBX_TRACE_SCOPE("deflate", std::to_string(arraySize) + " bytes");
+                ScopedTimer deflateTimer(timer(pStatistics, &Statistics::deflateSeconds));
+                if (compress(&data[dataPos], &destLength, array.data(), arraySize) == MZ_OK && destLength < arraySize)
+                {
+                    compressedLength = static_cast<uint32_t>(destLength);
+                    encoding = 1;
+                    if (pStatistics != nullptr)
+                    {
+                        pStatistics->compressedBytes += compressedLength;
+                        pStatistics->decompressedBytes += arraySize;
+                    }
+                }
+                data.resize(dataPos + (encoding == 1 ? compressedLength : 0));
+            }
+
+            if (encoding == 0)
+            {
+                data.insert(data.end(), array.data(), array.data() + arraySize);
+            }
+
+            memcpy(&data[headerPos], &encoding, 4);
+            memcpy(&data[headerPos + 4], &compressedLength, 4);
+        }
+    }
+
+
+    // Object index
+    ObjectIndex::ObjectIndex() :
+        m_size(0)
+    {
+    }
+
+    ObjectIndex::ObjectIndex(Record & record) :
+        ObjectIndex()
+    {
+        build(record);
+    }
+
+    void ObjectIndex::build(Record & record)
+    {
+        clear();
+
+        // Accept both the root record and the Objects record itself.
+        Record * pObjects = &record;
+        if (nameEquals(record.name(), "Objects") == false)
+        {
+            auto it = record.find("Objects");
+            if (it == record.end())
+            {
+                return;
+            }
+            pObjects = *it;
+        }
+
+        m_entries.assign(hashCapacity(pObjects->size()), Entry{ 0, nullptr });
+
+        for (auto it = pObjects->begin(); it != pObjects->end(); ++it)
+        {
+            Record * pObject = *it;
+            if (pObject->properties().size() == 0 || pObject->properties().front()->type() != Property::Type::Integer64)
+            {
+                continue;
+            }
+
+            const int64_t uid = pObject->properties().front()->get<int64_t>();
+            Entry & entry = m_entries[slot(uid)];
+            if (entry.record == nullptr)
+            {
+                entry.uid = uid;
+                entry.record = pObject;
+                ++m_size;
+            }
+        }
+    }
+
+    size_t ObjectIndex::size() const
+    {
+        return m_size;
+    }
+
+    Record * ObjectIndex::find(const int64_t uid)
+    {
+        if (m_size == 0)
+        {
+            return nullptr;
+        }
+        return m_entries[slot(uid)].record;
+    }
+    const Record * ObjectIndex::find(const int64_t uid) const
+    {
+        if (m_size == 0)
+        {
+            return nullptr;
+        }
+        return m_entries[slot(uid)].record;
+    }
+
+    void ObjectIndex::clear()
+    {
+        m_entries.clear();
+        m_size = 0;
+    }
+
+    size_t ObjectIndex::slot(const int64_t uid) const
+    {
+        // Linear probing, stopping at a matching or an empty slot.
+        const size_t mask = m_entries.size() - 1;
+        size_t index = static_cast<size_t>(hashUid(uid)) & mask;
+        while (m_entries[index].record != nullptr && m_entries[index].uid != uid)
+        {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+
+    // Connection graph
+    ConnectionGraph::ConnectionGraph()
+    {
+        clear();
+    }
+
+    ConnectionGraph::ConnectionGraph(const Record & record) :
+        ConnectionGraph()
+    {
+        build(record);
+    }
+
+    void ConnectionGraph::build(const Record & record)
+    {
+        clear();
+
+        // Accept both the root record and the Connections record itself.
+        const Record * pConnections = &record;
+        if (nameEquals(record.name(), "Connections") == false)
+        {
+            auto it = record.find("Connections");
+            if (it == record.end())
+            {
+                return;
+            }
+            pConnections = *it;
+        }
+
+        struct Edge
+        {
+            uint32_t    child;
+            uint32_t    parent;
+            Connection  connection;
+        };
+
+        std::vector<Edge> edges;
+        edges.reserve(pConnections->size());
+        m_slots.assign(hashCapacity(pConnections->size() * 2), 0);
+        std::unordered_map<std::string, uint32_t> labelIndices;
+
+        auto addNode = [this](const int64_t uid)
+        {
+            const size_t index = slot(uid);
+            if (m_slots[index] == 0)
+            {
+                m_uids.push_back(uid);
+                m_slots[index] = static_cast<uint32_t>(m_uids.size());
+            }
+            return m_slots[index] - 1;
+        };
+        auto addLabel = [this, &labelIndices](const Property * property)
+        {
+            const std::string name = property->string();
+            auto it = labelIndices.find(name);
+            if (it != labelIndices.end())
+            {
+                return it->second;
+            }
+            const uint32_t index = static_cast<uint32_t>(m_labels.size());
+            m_labels.push_back(name);
+            labelIndices[name] = index;
+            return index;
+        };
+
+        // Single pass over the C records, mapping UIDs to dense node indices.
+        for (auto it = pConnections->begin(); it != pConnections->end(); ++it)
+        {
+            const PropertyList & properties = (*it)->properties();
+            if (nameEquals((*it)->name(), "C") == false || properties.size() < 3)
+            {
+                continue;
+            }
+
+            auto pIt = properties.begin();
+            const Property * pType = *pIt++;
+            const Property * pChild = *pIt++;
+            const Property * pParent = *pIt++;
+            if (pType->isString() == false || pChild->type() != Property::Type::Integer64 || pParent->type() != Property::Type::Integer64)
+            {
+                continue;
+            }
+
+            const std::string type = pType->string();
+            Edge edge;
+            edge.connection.childProperty = 0;
+            edge.connection.parentProperty = 0;
+            if (type == "OO")
+            {
+                edge.connection.type = Type::ObjectObject;
+            }
+            else if (type == "OP")
+            {
+                edge.connection.type = Type::ObjectProperty;
+                edge.connection.parentProperty = pIt != properties.end() ? addLabel(*pIt) : 0;
+            }
+            else if (type == "PO")
+            {
+                edge.connection.type = Type::PropertyObject;
+                edge.connection.childProperty = pIt != properties.end() ? addLabel(*pIt) : 0;
+            }
+            else if (type == "PP")
+            {
+                edge.connection.type = Type::PropertyProperty;
+                edge.connection.childProperty = pIt != properties.end() ? addLabel(*pIt++) : 0;
+                edge.connection.parentProperty = pIt != properties.end() ? addLabel(*pIt) : 0;
+            }
+            else
+            {
+                continue;
+            }
+
+            edge.child = addNode(pChild->get<int64_t>());
+            edge.parent = addNode(pParent->get<int64_t>());
+            edges.push_back(edge);
+        }
+
+        // Counting sort of the edges into CSR adjacency arrays for both directions.
+        const size_t nodeCount = m_uids.size();
+        m_childOffsets.assign(nodeCount + 1, 0);
+        m_parentOffsets.assign(nodeCount + 1, 0);
+        for (const auto & edge : edges)
+        {
+            ++m_childOffsets[edge.parent + 1];
+            ++m_parentOffsets[edge.child + 1];
+        }
+        for (size_t i = 0; i < nodeCount; i++)
+        {
+            m_childOffsets[i + 1] += m_childOffsets[i];
+            m_parentOffsets[i + 1] += m_parentOffsets[i];
+        }
+
+        m_children.resize(edges.size());
+        m_parents.resize(edges.size());
+        std::vector<uint32_t> childCursor(m_childOffsets.begin(), m_childOffsets.end() - 1);
+        std::vector<uint32_t> parentCursor(m_parentOffsets.begin(), m_parentOffsets.end() - 1);
+        for (const auto & edge : edges)
+        {
+            Connection & child = m_children[childCursor[edge.parent]++];
+            child = edge.connection;
+            child.uid = m_uids[edge.child];
+
+            Connection & parent = m_parents[parentCursor[edge.child]++];
+            parent = edge.connection;
+            parent.uid = m_uids[edge.parent];
+        }
+    }
+
+    size_t ConnectionGraph::size() const
+    {
+        return m_children.size();
+    }
+
+    bool ConnectionGraph::contains(const int64_t uid) const
+    {
+        return node(uid) != std::numeric_limits<uint32_t>::max();
+    }
+
+    Span<const ConnectionGraph::Connection> ConnectionGraph::children(const int64_t uid) const
+    {
+        const uint32_t index = node(uid);
+        if (index == std::numeric_limits<uint32_t>::max())
+        {
+            return Span<const Connection>();
+        }
+        return Span<const Connection>(m_children.data() + m_childOffsets[index], m_childOffsets[index + 1] - m_childOffsets[index]);
+    }
+
+    Span<const ConnectionGraph::Connection> ConnectionGraph::parents(const int64_t uid) const
+    {
+        const uint32_t index = node(uid);
+        if (index == std::numeric_limits<uint32_t>::max())
+        {
+            return Span<const Connection>();
+        }
+        return Span<const Connection>(m_parents.data() + m_parentOffsets[index], m_parentOffsets[index + 1] - m_parentOffsets[index]);
+    }
+
+    const std::string & ConnectionGraph::label(const uint32_t index) const
+    {
+        return m_labels.at(index);
+    }
+
+    void ConnectionGraph::clear()
+    {
+        m_uids.clear();
+        m_slots.clear();
+        m_childOffsets.clear();
+        m_children.clear();
+        m_parentOffsets.clear();
+        m_parents.clear();
+        m_labels.assign(1, std::string());
+    }
+
+    size_t ConnectionGraph::slot(const int64_t uid) const
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t index = static_cast<size_t>(hashUid(uid)) & mask;
+        while (m_slots[index] != 0 && m_uids[m_slots[index] - 1] != uid)
+        {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    uint32_t ConnectionGraph::node(const int64_t uid) const
+    {
+        if (m_slots.empty())
+        {
+            return std::numeric_limits<uint32_t>::max();
+        }
+        const uint32_t value = m_slots[slot(uid)];
+        return value != 0 ? value - 1 : std::numeric_limits<uint32_t>::max();
+    }
+
+
+    // Property table
+    PropertyTable::PropertyTable() :
+        m_pProperties(nullptr),
+        m_pDefaults(nullptr)
+    {
+    }
+
+    PropertyTable::PropertyTable(const Record & record, const PropertyTable * defaults) :
+        PropertyTable()
+    {
+        reset(record, defaults);
+    }
+
+    uint32_t PropertyTable::intern(const std::string & name)
+    {
+        return NamePool::instance().intern(name);
+    }
+
+    void PropertyTable::reset(const Record & record, const PropertyTable * defaults)
+    {
+        // Accept both the object record and its Properties70 record.
+        m_pProperties = &record;
+        if (nameEquals(record.name(), "Properties70") == false)
+        {
+            auto it = record.find("Properties70");
+            m_pProperties = it != record.end() ? *it : nullptr;
+        }
+
+        m_pDefaults = defaults;
+        m_entries.clear();
+        m_slots.clear();
+        build();
+    }
+
+    size_t PropertyTable::size() const
+    {
+        return m_entries.size();
+    }
+
+    const PropertyTable::Entry * PropertyTable::find(const uint32_t name) const
+    {
+        if (m_entries.size())
+        {
+            const size_t mask = m_slots.size() - 1;
+            size_t index = static_cast<size_t>(hashUid(name)) & mask;
+            while (m_slots[index] != 0)
+            {
+                const Entry & entry = m_entries[m_slots[index] - 1];
+                if (entry.name == name)
+                {
+                    return &entry;
+                }
+                index = (index + 1) & mask;
+            }
+        }
+
+        return m_pDefaults != nullptr ? m_pDefaults->find(name) : nullptr;
+    }
+
+    const PropertyTable::Entry * PropertyTable::find(const std::string & name) const
+    {
+        uint32_t id = 0;
+        if (NamePool::instance().find(name, id) == false)
+        {
+            return nullptr;
+        }
+        return find(id);
+    }
+
+    int64_t PropertyTable::integer(const uint32_t name, const int64_t defaultValue) const
+    {
+        const Entry * pEntry = find(name);
+        if (pEntry == nullptr)
+        {
+            return defaultValue;
+        }
+
+        switch (pEntry->kind)
+        {
+            case Kind::Integer: return pEntry->integer;
+            case Kind::Number: return static_cast<int64_t>(pEntry->values[0]);
+            default: break;
+        }
+        return defaultValue;
+    }
+
+    double PropertyTable::number(const uint32_t name, const double defaultValue) const
+    {
+        const Entry * pEntry = find(name);
+        if (pEntry == nullptr)
+        {
+            return defaultValue;
+        }
+
+        switch (pEntry->kind)
+        {
+            case Kind::Integer: return static_cast<double>(pEntry->integer);
+            case Kind::Number:
+            case Kind::Vector: return pEntry->values[0];
+            default: break;
+        }
+        return defaultValue;
+    }
+
+    bool PropertyTable::vector(const uint32_t name, double values[3]) const
+    {
+        const Entry * pEntry = find(name);
+        if (pEntry == nullptr || pEntry->kind != Kind::Vector || pEntry->count < 3)
+        {
+            return false;
+        }
+
+        values[0] = pEntry->values[0];
+        values[1] = pEntry->values[1];
+        values[2] = pEntry->values[2];
+        return true;
+    }
+
+    // Built when the table is set up rather than on first lookup, so tables shared between threads are only read.
+    void PropertyTable::build()
+    {
+        if (m_pProperties == nullptr)
+        {
+            return;
+        }
+
+        auto toString = [](const Property * pProperty)
+        {
+            const Span<const uint8_t> raw = pProperty->raw();
+            return Span<const char>(reinterpret_cast<const char *>(raw.data()), raw.size());
+        };
+
+        // P records hold name, type, label and flags strings, followed by the values.
+        m_entries.reserve(m_pProperties->size());
+        for (auto it = m_pProperties->begin(); it != m_pProperties->end(); ++it)
+        {
+            const PropertyList & properties = (*it)->properties();
+            if (properties.size() < 4)
+            {
+                continue;
+            }
+
+            auto pIt = properties.begin();
+            const Property * pName = *pIt++;
+            const Property * pType = *pIt++;
+            ++pIt;
+            const Property * pFlags = *pIt++;
+            if (pName->isString() == false)
+            {
+                continue;
+            }
+
+            Entry entry;
+            const Span<const char> name = toString(pName);
+            entry.name = NamePool::instance().intern(name.data(), name.size());
+            entry.kind = Kind::None;
+            entry.count = 0;
+            entry.type = toString(pType);
+            entry.flags = toString(pFlags);
+            entry.integer = 0;
+            entry.values[0] = entry.values[1] = entry.values[2] = entry.values[3] = 0.0;
+
+            for (; pIt != properties.end() && entry.count < 4; ++pIt)
+            {
+                const Property * pValue = *pIt;
+                switch (pValue->type())
+                {
+                    case Property::Type::Boolean: entry.integer = pValue->get<bool>() ? 1 : 0; entry.kind = Kind::Integer; break;
+                    case Property::Type::Integer16: entry.integer = pValue->get<int16_t>(); entry.kind = Kind::Integer; break;
+                    case Property::Type::Integer32: entry.integer = pValue->get<int32_t>(); entry.kind = Kind::Integer; break;
+                    case Property::Type::Integer64: entry.integer = pValue->get<int64_t>(); entry.kind = Kind::Integer; break;
+                    case Property::Type::Float32: entry.values[entry.count] = pValue->get<float>(); entry.kind = Kind::Number; break;
+                    case Property::Type::Float64: entry.values[entry.count] = pValue->get<double>(); entry.kind = Kind::Number; break;
+                    case Property::Type::String: entry.string = toString(pValue); entry.kind = Kind::String; break;
+                    default: break;
+                }
+                ++entry.count;
+            }
+            if (entry.kind == Kind::Number && entry.count > 1)
+            {
+                entry.kind = Kind::Vector;
+            }
+
+            m_entries.push_back(entry);
+        }
+
+        m_slots.assign(hashCapacity(m_entries.size()), 0);
+        const size_t mask = m_slots.size() - 1;
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            size_t index = static_cast<size_t>(hashUid(m_entries[i].name)) & mask;
+            while (m_slots[index] != 0 && m_entries[m_slots[index] - 1].name != m_entries[i].name)
+            {
+                index = (index + 1) & mask;
+            }
+            m_slots[index] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+
+    // Mesh extraction
+    namespace
+    {
+        const Property * firstProperty(const Record & record, const std::string & name)
+        {
+            auto it = record.find(name);
+            if (it == record.end() || (*it)->properties().size() == 0)
+            {
+                return nullptr;
+            }
+            return (*it)->properties().front();
+        }
+
+        // Returns the property itself, or a decoded copy held by storage if its array is still encoded.
+        const Property * decoded(const Property * pProperty, std::unique_ptr<Property> & storage)
+        {
+            if (pProperty == nullptr || pProperty->isEncoded() == false)
+            {
+                return pProperty;
+            }
+            storage.reset(new Property(*pProperty));
+            storage->decode();
+            return storage.get();
+        }
+
+        // Copies a float32 or float64 array property into doubles.
+        bool readDoubles(const Property * pEncoded, std::vector<double> & values)
+        {
+            std::unique_ptr<Property> storage;
+            const Property * pProperty = decoded(pEncoded, storage);
+            if (pProperty == nullptr)
+            {
+                return false;
+            }
+
+            if (pProperty->type() == Property::Type::Float64Array)
+            {
+                const Property::Lease lease = pProperty->lease();
+                const Span<const double> array = lease.getArray<double>();
+                values.assign(array.begin(), array.end());
+                return true;
+            }
+            if (pProperty->type() == Property::Type::Float32Array)
+            {
+                const Property::Lease lease = pProperty->lease();
+                const Span<const float> array = lease.getArray<float>();
+                values.assign(array.begin(), array.end());
+                return true;
+            }
+            return false;
+        }
+
+        // Decoded LayerElement* record, resolving mapping and reference modes to a source element per corner.
+        class LayerElement
+        {
+
+        public:
+
+            enum class Mapping
+            {
+                ByPolygonVertex,
+                ByVertex,
+                ByPolygon,
+                AllSame
+            };
+
+            LayerElement() :
+                m_valid(false),
+                m_mapping(Mapping::ByPolygonVertex),
+                m_components(0)
+            {}
+
+            bool load(const Record & geometry, const std::string & elementName, const std::string & dataName, const std::string & indexName, const size_t components)
+            {
+                auto it = geometry.find(elementName);
+                if (it == geometry.end())
+                {
+                    return false;
+                }
+                const Record & element = **it;
+
+                if (readDoubles(firstProperty(element, dataName), m_data) == false)
+                {
+                    return false;
+                }
+                m_components = components;
+
+                const Property * pMapping = firstProperty(element, "MappingInformationType");
+                const std::string mapping = pMapping != nullptr ? pMapping->string() : "ByPolygonVertex";
+                if (mapping == "ByPolygonVertex")
+                {
+                    m_mapping = Mapping::ByPolygonVertex;
+                }
+                else if (mapping == "ByVertex" || mapping == "ByVertice")
+                {
+                    m_mapping = Mapping::ByVertex;
+                }
+                else if (mapping == "ByPolygon")
+                {
+                    m_mapping = Mapping::ByPolygon;
+                }
+                else if (mapping == "AllSame")
+                {
+                    m_mapping = Mapping::AllSame;
+                }
+                else
+                {
+                    return false;
+                }
+
+                const Property * pReference = firstProperty(element, "ReferenceInformationType");
+                const std::string reference = pReference != nullptr ? pReference->string() : "Direct";
+                if (reference == "IndexToDirect" || reference == "Index")
+                {
+                    const Property * pIndices = decoded(firstProperty(element, indexName), m_pDecodedIndices);
+                    if (pIndices == nullptr || pIndices->type() != Property::Type::Integer32Array)
+                    {
+                        return false;
+                    }
+                    m_indicesLease = pIndices->lease();
+                    m_indices = m_indicesLease.getArray<int32_t>();
+                }
+
+                m_valid = true;
+                return true;
+            }
+
+            bool valid() const
+            {
+                return m_valid;
+            }
+
+            Mapping mapping() const
+            {
+                return m_mapping;
+            }
+
+            // Writes the attribute of corners [begin, end) to output, resolving the mapped element index.
+            void gather(const size_t begin, const size_t end, const int32_t * vertexIndices, const uint32_t * cornerPolygons, float * output) const
+            {
+                const size_t elementCount = m_data.size() / m_components;
+                for (size_t corner = begin; corner < end; corner++)
+                {
+                    size_t index = 0;
+                    switch (m_mapping)
+                    {
+                        case Mapping::ByPolygonVertex: index = corner; break;
+                        case Mapping::ByVertex: index = static_cast<size_t>(vertexIndices[corner] < 0 ? ~vertexIndices[corner] : vertexIndices[corner]); break;
+                        case Mapping::ByPolygon: index = cornerPolygons[corner]; break;
+                        case Mapping::AllSame: index = 0; break;
+                    }
+
+                    if (m_indices.size())
+                    {
+                        if (index >= m_indices.size())
+                        {
+                            throw std::runtime_error("Layer element index out of range.");
+                        }
+                        index = static_cast<size_t>(m_indices[index]);
+                    }
+                    if (index >= elementCount)
+                    {
+                        throw std::runtime_error("Layer element data index out of range.");
+                    }
+
+                    const double * pSource = &m_data[index * m_components];
+                    float * pDestination = output + corner * m_components;
+                    for (size_t i = 0; i < m_components; i++)
+                    {
+                        pDestination[i] = static_cast<float>(pSource[i]);
+                    }
+                }
+            }
+
+        private:
+
+            bool                        m_valid;
+            Mapping                     m_mapping;
+            size_t                      m_components;
+            std::vector<double>         m_data;
+            Span<const int32_t>         m_indices;
+            std::unique_ptr<Property>   m_pDecodedIndices;
+            Property::Lease             m_indicesLease;
+
+        };
+    }
+
+    namespace
+    {
+        // Ear clips a polygon given as corner indices, projecting it onto the plane of its Newell normal.
+        // Convex polygons come out in fan order; degenerate remainders fall back to a fan.
+        class EarClipper
+        {
+
+        public:
+
+            uint32_t * clip(const uint32_t first, const uint32_t last, const int32_t * pVertexIndices, const Span<const double> & vertices, uint32_t * pOutput)
+            {
+                const size_t size = last - first;
+                const size_t vertexCount = vertices.size() / 3;
+
+                double normal[3] = { 0.0, 0.0, 0.0 };
+                m_points.resize(size * 3);
+                for (size_t i = 0; i < size; i++)
+                {
+                    const int32_t value = pVertexIndices[first + i];
+                    const size_t vertex = static_cast<size_t>(value < 0 ? ~value : value);
+                    if (vertex >= vertexCount)
+                    {
+                        throw std::runtime_error("Polygon vertex index out of range.");
+                    }
+                    m_points[i * 3] = vertices[vertex * 3];
+                    m_points[i * 3 + 1] = vertices[vertex * 3 + 1];
+                    m_points[i * 3 + 2] = vertices[vertex * 3 + 2];
+                }
+                for (size_t i = 0; i < size; i++)
+                {
+                    const double * a = &m_points[i * 3];
+                    const double * b = &m_points[((i + 1) % size) * 3];
+                    normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+                    normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+                    normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+                }
+
+                // Drop the dominant axis of the normal, keeping the projection counter-clockwise.
+                size_t axis = 2;
+                if (std::abs(normal[0]) >= std::abs(normal[1]) && std::abs(normal[0]) >= std::abs(normal[2]))
+                {
+                    axis = 0;
+                }
+                else if (std::abs(normal[1]) >= std::abs(normal[2]))
+                {
+                    axis = 1;
+                }
+                const size_t u = (axis + 1) % 3;
+                const size_t v = (axis + 2) % 3;
+                const double orientation = normal[axis] < 0.0 ? -1.0 : 1.0;
+
+                m_projected.resize(size * 2);
+                m_ring.resize(size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    m_projected[i * 2] = m_points[i * 3 + u];
+                    m_projected[i * 2 + 1] = m_points[i * 3 + v] * orientation;
+                    m_ring[i] = static_cast<uint32_t>(i);
+                }
+
+                while (m_ring.size() > 3)
+                {
+                    const size_t count = m_ring.size();
+                    bool clipped = false;
+                    for (size_t i = 1; i <= count && clipped == false; i++)
+                    {
+                        const size_t current = i % count;
+                        const uint32_t a = m_ring[(current + count - 1) % count];
+                        const uint32_t b = m_ring[current];
+                        const uint32_t c = m_ring[(current + 1) % count];
+                        if (isEar(a, b, c))
+                        {
+                            *pOutput++ = first + a;
+                            *pOutput++ = first + b;
+                            *pOutput++ = first + c;
+                            m_ring.erase(m_ring.begin() + current);
+                            clipped = true;
+                        }
+                    }
+                    if (clipped == false)
+                    {
+                        break;
+                    }
+                }
+
+                for (size_t i = 1; i + 1 < m_ring.size(); i++)
+                {
+                    *pOutput++ = first + m_ring[0];
+                    *pOutput++ = first + m_ring[i];
+                    *pOutput++ = first + m_ring[i + 1];
+                }
+                return pOutput;
+            }
+
+        private:
+
+            double cross(const uint32_t a, const uint32_t b, const uint32_t c) const
+            {
+                const double * pA = &m_projected[a * 2];
+                const double * pB = &m_projected[b * 2];
+                const double * pC = &m_projected[c * 2];
+                return (pB[0] - pA[0]) * (pC[1] - pA[1]) - (pB[1] - pA[1]) * (pC[0] - pA[0]);
+            }
+
+            bool isEar(const uint32_t a, const uint32_t b, const uint32_t c) const
+            {
+                if (cross(a, b, c) <= 0.0)
+                {
+                    return false;
+                }
+                for (auto point : m_ring)
+                {
+                    if (point == a || point == b || point == c)
+                    {
+                        continue;
+                    }
+                    if (cross(a, b, point) >= 0.0 && cross(b, c, point) >= 0.0 && cross(c, a, point) >= 0.0)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            std::vector<double>     m_points;
+            std::vector<double>     m_projected;
+            std::vector<uint32_t>   m_ring;
+
+        };
+    }
+
+    Triangulation triangulate(const Span<const int32_t> & polygonVertexIndex, const Span<const double> & vertices, const unsigned int threads)
+    {
+        const size_t blockSize = 64 * 1024;
+        const size_t cornerCount = polygonVertexIndex.size();
+        const int32_t * pVertexIndices = polygonVertexIndex.data();
+
+        Triangulation triangulation;
+        if (cornerCount == 0)
+        {
+            triangulation.polygons.push_back(0);
+            return triangulation;
+        }
+        if (pVertexIndices[cornerCount - 1] >= 0)
+        {
+            throw std::runtime_error("Polygon vertex indices are not terminated.");
+        }
+
+        // Count polygon ends per block; the sign bit is the terminator flag so the loop stays branch free.
+        const size_t cornerBlocks = (cornerCount + blockSize - 1) / blockSize;
+        std::vector<size_t> blockOffsets(cornerBlocks + 1, 0);
+        parallelFor(cornerBlocks, 1, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t block = begin; block < end; block++)
+            {
+                const size_t last = std::min(cornerCount, (block + 1) * blockSize);
+                size_t count = 0;
+                for (size_t corner = block * blockSize; corner < last; corner++)
+                {
+                    count += static_cast<uint32_t>(pVertexIndices[corner]) >> 31;
+                }
+                blockOffsets[block + 1] = count;
+            }
+        });
+        for (size_t block = 0; block < cornerBlocks; block++)
+        {
+            blockOffsets[block + 1] += blockOffsets[block];
+        }
+
+        const size_t polygonCount = blockOffsets.back();
+        std::vector<uint32_t> & polygons = triangulation.polygons;
+        polygons.resize(polygonCount + 1);
+        polygons[0] = 0;
+        parallelFor(cornerBlocks, 1, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t block = begin; block < end; block++)
+            {
+                const size_t last = std::min(cornerCount, (block + 1) * blockSize);
+                uint32_t * pOutput = &polygons[blockOffsets[block] + 1];
+                for (size_t corner = block * blockSize; corner < last; corner++)
+                {
+                    if (pVertexIndices[corner] < 0)
+                    {
+                        *pOutput++ = static_cast<uint32_t>(corner + 1);
+                    }
+                }
+            }
+        });
+
+        // Size the index buffer with a prefix sum of triangles per polygon.
+        const size_t polygonBlocks = (polygonCount + blockSize - 1) / blockSize;
+        std::vector<uint32_t> triangleOffsets(polygonCount + 1, 0);
+        std::vector<size_t> blockTriangles(polygonBlocks + 1, 0);
+        parallelFor(polygonBlocks, 1, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t block = begin; block < end; block++)
+            {
+                const size_t last = std::min(polygonCount, (block + 1) * blockSize);
+                uint32_t sum = 0;
+                for (size_t polygon = block * blockSize; polygon < last; polygon++)
+                {
+                    const uint32_t size = polygons[polygon + 1] - polygons[polygon];
+                    sum += size >= 3 ? size - 2 : 0;
+                    triangleOffsets[polygon + 1] = sum;
+                }
+                blockTriangles[block + 1] = sum;
+            }
+        });
+        for (size_t block = 0; block < polygonBlocks; block++)
+        {
+            blockTriangles[block + 1] += blockTriangles[block];
+        }
+
+        triangulation.indices.resize(blockTriangles.back() * 3);
+        uint32_t * pIndices = triangulation.indices.data();
+        parallelFor(polygonBlocks, 1, threads, [&](const size_t begin, const size_t end)
+        {
+            EarClipper clipper;
+            for (size_t block = begin; block < end; block++)
+            {
+                const size_t last = std::min(polygonCount, (block + 1) * blockSize);
+                for (size_t polygon = block * blockSize; polygon < last; polygon++)
+                {
+                    const uint32_t first = polygons[polygon];
+                    const uint32_t size = polygons[polygon + 1] - first;
+                    const size_t triangleOffset = blockTriangles[block] + (polygon == block * blockSize ? 0 : triangleOffsets[polygon]);
+                    uint32_t * pOutput = pIndices + triangleOffset * 3;
+                    if (size > 3 && vertices.size())
+                    {
+                        clipper.clip(first, first + size, pVertexIndices, vertices, pOutput);
+                        continue;
+                    }
+                    for (uint32_t corner = first + 1; corner + 1 < first + size; corner++)
+                    {
+                        *pOutput++ = first;
+                        *pOutput++ = corner;
+                        *pOutput++ = corner + 1;
+                    }
+                }
+            }
+        });
+
+        return triangulation;
+    }
+
+    Mesh extractMesh(const Record & geometry, const unsigned int threads)
+    {
+        const size_t grain = 16 * 1024;
+
+        std::vector<double> vertices;
+        if (readDoubles(firstProperty(geometry, "Vertices"), vertices) == false)
+        {
+            throw std::runtime_error("Geometry is missing vertices.");
+        }
+        std::unique_ptr<Property> decodedPolygonVertexIndex;
+        const Property * pPolygonVertexIndex = decoded(firstProperty(geometry, "PolygonVertexIndex"), decodedPolygonVertexIndex);
+        if (pPolygonVertexIndex == nullptr || pPolygonVertexIndex->type() != Property::Type::Integer32Array)
+        {
+            throw std::runtime_error("Geometry is missing polygon vertex indices.");
+        }
+
+        // Leased, as loading the layer elements below may page other arrays in.
+        const Property::Lease vertexIndexLease = pPolygonVertexIndex->lease();
+        const Span<const int32_t> vertexIndices = vertexIndexLease.getArray<int32_t>();
+        const size_t cornerCount = vertexIndices.size();
+        const size_t vertexCount = vertices.size() / 3;
+
+        Triangulation triangulation = triangulate(vertexIndices, Span<const double>(vertices.data(), vertices.size()), threads);
+        const std::vector<uint32_t> & polygonStarts = triangulation.polygons;
+        const size_t polygonCount = polygonStarts.size() - 1;
+
+        Mesh mesh;
+
+        // De-index positions, one output vertex per polygon corner.
+        mesh.positions.resize(cornerCount * 3);
+        float * pPositions = mesh.positions.data();
+        parallelFor(cornerCount, grain, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t corner = begin; corner < end; corner++)
+            {
+                const int32_t value = vertexIndices[corner];
+                const size_t vertex = static_cast<size_t>(value < 0 ? ~value : value);
+                if (vertex >= vertexCount)
+                {
+                    throw std::runtime_error("Polygon vertex index out of range.");
+                }
+                pPositions[corner * 3] = static_cast<float>(vertices[vertex * 3]);
+                pPositions[corner * 3 + 1] = static_cast<float>(vertices[vertex * 3 + 1]);
+                pPositions[corner * 3 + 2] = static_cast<float>(vertices[vertex * 3 + 2]);
+            }
+        });
+
+        LayerElement normals;
+        LayerElement uvs;
+        LayerElement colors;
+        normals.load(geometry, "LayerElementNormal", "Normals", "NormalsIndex", 3);
+        uvs.load(geometry, "LayerElementUV", "UV", "UVIndex", 2);
+        colors.load(geometry, "LayerElementColor", "Colors", "ColorIndex", 4);
+
+        // Polygon index of every corner, only needed by ByPolygon mapped elements.
+        std::vector<uint32_t> cornerPolygons;
+        if ((normals.valid() && normals.mapping() == LayerElement::Mapping::ByPolygon) ||
+            (uvs.valid() && uvs.mapping() == LayerElement::Mapping::ByPolygon) ||
+            (colors.valid() && colors.mapping() == LayerElement::Mapping::ByPolygon))
+        {
+            cornerPolygons.resize(cornerCount);
+            parallelFor(polygonCount, grain, threads, [&](const size_t begin, const size_t end)
+            {
+                for (size_t polygon = begin; polygon < end; polygon++)
+                {
+                    std::fill(cornerPolygons.begin() + polygonStarts[polygon], cornerPolygons.begin() + polygonStarts[polygon + 1], static_cast<uint32_t>(polygon));
+                }
+            });
+        }
+
+        auto gather = [&](const LayerElement & element, std::vector<float> & output, const size_t components)
+        {
+            if (element.valid() == false)
+            {
+                return;
+            }
+            output.resize(cornerCount * components);
+            parallelFor(cornerCount, grain, threads, [&](const size_t begin, const size_t end)
+            {
+                element.gather(begin, end, vertexIndices.data(), cornerPolygons.data(), output.data());
+            });
+        };
+        gather(normals, mesh.normals, 3);
+        gather(uvs, mesh.uvs, 2);
+        gather(colors, mesh.colors, 4);
+
+        mesh.indices = std::move(triangulation.indices);
+
+        return mesh;
+    }
+
+
+    // Skin extraction
+    namespace
+    {
+        bool isObject(const Record * pRecord, const std::string & name, const std::string & type)
+        {
+            if (pRecord == nullptr || nameEquals(pRecord->name(), name) == false)
+            {
+                return false;
+            }
+            if (type.empty())
+            {
+                return true;
+            }
+            const PropertyList & properties = pRecord->properties();
+            return properties.size() >= 3 && properties.back()->isString() && properties.back()->string() == type;
+        }
+
+        struct Influence
+        {
+            uint32_t    joint;
+            float       weight;
+        };
+    }
+
+    SkinWeights extractSkin(const Record & skin, const ObjectIndex & objects, const ConnectionGraph & connections, const uint32_t influences, const unsigned int threads)
+    {
+        if (skin.properties().size() == 0 || skin.properties().front()->type() != Property::Type::Integer64)
+        {
+            throw std::runtime_error("Skin deformer is missing its uid.");
+        }
+        if (influences == 0)
+        {
+            throw std::runtime_error("Skin influence count must be positive.");
+        }
+        const int64_t skinUid = skin.properties().front()->get<int64_t>();
+
+        // Clusters hang below the skin, each with its bone model connected below it.
+        struct Cluster
+        {
+            std::unique_ptr<Property>   indexStorage;
+            Span<const int32_t>         indices;
+            std::vector<double>         weights;
+        };
+        std::vector<Cluster> clusters;
+        SkinWeights result;
+        result.influences = influences;
+
+        const Span<const ConnectionGraph::Connection> skinChildren = connections.children(skinUid);
+        clusters.reserve(skinChildren.size());
+        for (auto & connection : skinChildren)
+        {
+            const Record * pCluster = objects.find(connection.uid);
+            if (connection.type != ConnectionGraph::Type::ObjectObject || isObject(pCluster, "Deformer", "Cluster") == false)
+            {
+                continue;
+            }
+
+            int64_t boneUid = 0;
+            for (auto & clusterChild : connections.children(connection.uid))
+            {
+                if (isObject(objects.find(clusterChild.uid), "Model", ""))
+                {
+                    boneUid = clusterChild.uid;
+                    break;
+                }
+            }
+
+            clusters.push_back(Cluster());
+            Cluster & cluster = clusters.back();
+            const Property * pIndexes = decoded(firstProperty(*pCluster, "Indexes"), cluster.indexStorage);
+            if (pIndexes != nullptr && pIndexes->type() == Property::Type::Integer32Array)
+            {
+                cluster.indices = pIndexes->getArray<int32_t>();
+            }
+            readDoubles(firstProperty(*pCluster, "Weights"), cluster.weights);
+            if (cluster.indices.size() != cluster.weights.size())
+            {
+                throw std::runtime_error("Cluster indexes and weights differ in length.");
+            }
+            result.bones.push_back(boneUid);
+        }
+
+        // Vertex count of the skinned geometry, or the largest referenced vertex without one.
+        size_t vertexCount = 0;
+        bool hasGeometry = false;
+        for (auto & connection : connections.parents(skinUid))
+        {
+            const Record * pGeometry = objects.find(connection.uid);
+            if (isObject(pGeometry, "Geometry", ""))
+            {
+                const Property * pVertices = firstProperty(*pGeometry, "Vertices");
+                vertexCount = pVertices != nullptr ? pVertices->size() / 3 : 0;
+                hasGeometry = true;
+                break;
+            }
+        }
+        if (hasGeometry == false)
+        {
+            for (auto & cluster : clusters)
+            {
+                for (auto index : cluster.indices)
+                {
+                    vertexCount = std::max(vertexCount, static_cast<size_t>(index) + 1);
+                }
+            }
+        }
+
+        // Invert cluster lists into per vertex lists: count, prefix sum, then scatter in parallel across clusters.
+        std::unique_ptr<std::atomic<uint32_t>[]> pCounts(new std::atomic<uint32_t>[vertexCount + 1]);
+        for (size_t i = 0; i <= vertexCount; i++)
+        {
+            pCounts[i].store(0, std::memory_order_relaxed);
+        }
+        parallelFor(clusters.size(), 1, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                const Cluster & cluster = clusters[c];
+                for (size_t i = 0; i < cluster.indices.size(); i++)
+                {
+                    const int32_t vertex = cluster.indices[i];
+                    if (vertex < 0 || static_cast<size_t>(vertex) >= vertexCount)
+                    {
+                        throw std::runtime_error("Cluster vertex index out of range.");
+                    }
+                    if (cluster.weights[i] > 0.0)
+                    {
+                        pCounts[vertex].fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        });
+
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            offsets[i + 1] = offsets[i] + pCounts[i].load(std::memory_order_relaxed);
+            pCounts[i].store(offsets[i], std::memory_order_relaxed);
+        }
+
+        std::vector<Influence> scattered(offsets.back());
+        parallelFor(clusters.size(), 1, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                const Cluster & cluster = clusters[c];
+                for (size_t i = 0; i < cluster.indices.size(); i++)
+                {
+                    if (cluster.weights[i] > 0.0)
+                    {
+                        const uint32_t position = pCounts[cluster.indices[i]].fetch_add(1, std::memory_order_relaxed);
+                        scattered[position] = Influence{ static_cast<uint32_t>(c), static_cast<float>(cluster.weights[i]) };
+                    }
+                }
+            }
+        });
+
+        // Keep the strongest influences of every vertex, ties broken by joint so the result is deterministic.
+        result.joints.assign(vertexCount * influences, 0);
+        result.weights.assign(vertexCount * influences, 0.0f);
+        parallelFor(vertexCount, 4096, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t vertex = begin; vertex < end; vertex++)
+            {
+                Influence * pFirst = scattered.data() + offsets[vertex];
+                Influence * pLast = scattered.data() + offsets[vertex + 1];
+                Influence * pKeep = pFirst + std::min<size_t>(influences, pLast - pFirst);
+                std::partial_sort(pFirst, pKeep, pLast, [](const Influence & a, const Influence & b)
+                {
+                    return a.weight > b.weight || (a.weight == b.weight && a.joint < b.joint);
+                });
+
+                float sum = 0.0f;
+                for (Influence * pInfluence = pFirst; pInfluence != pKeep; ++pInfluence)
+                {
+                    sum += pInfluence->weight;
+                }
+                uint32_t * pJoints = &result.joints[vertex * influences];
+                float * pWeights = &result.weights[vertex * influences];
+                for (Influence * pInfluence = pFirst; pInfluence != pKeep; ++pInfluence)
+                {
+                    *pJoints++ = pInfluence->joint;
+                    *pWeights++ = pInfluence->weight / sum;
+                }
+            }
+        });
+
+        return result;
+    }
+
+
+    // Animation
+    namespace
+    {
+        const uint32_t interpolationConstant = 0x00000002;
+        const uint32_t interpolationLinear = 0x00000004;
+        const uint32_t interpolationCubic = 0x00000008;
+        const uint32_t constantNext = 0x00000100;
+
+        template<typename T>
+        Span<const T> arrayOf(const Record & record, const std::string & name, std::unique_ptr<Property> & storage)
+        {
+            const Property * pProperty = decoded(firstProperty(record, name), storage);
+            if (pProperty == nullptr || pProperty->type() != PropertyTraits<T>::arrayType)
+            {
+                return Span<const T>();
+            }
+            return pProperty->getArray<T>();
+        }
+    }
+
+    const int64_t AnimationCurve::ticksPerSecond;
+
+    AnimationCurve::AnimationCurve() :
+        m_default(0.0f)
+    {
+    }
+
+    AnimationCurve::AnimationCurve(const Record & curve) :
+        AnimationCurve()
+    {
+        load(curve);
+    }
+
+    void AnimationCurve::load(const Record & curve)
+    {
+        m_times.clear();
+        m_values.clear();
+        m_interpolations.clear();
+        m_rightSlopes.clear();
+        m_nextLeftSlopes.clear();
+
+        const Property * pDefault = firstProperty(curve, "Default");
+        m_default = pDefault != nullptr && pDefault->type() == Property::Type::Float64 ? static_cast<float>(pDefault->get<double>()) : 0.0f;
+
+        std::unique_ptr<Property> timeStorage;
+        const Span<const int64_t> times = arrayOf<int64_t>(curve, "KeyTime", timeStorage);
+        std::vector<double> values;
+        if (readDoubles(firstProperty(curve, "KeyValueFloat"), values) == false)
+        {
+            readDoubles(firstProperty(curve, "KeyValueDouble"), values);
+        }
+        if (times.size() != values.size())
+        {
+            throw std::runtime_error("Animation curve key times and values differ in length.");
+        }
+
+        const size_t count = times.size();
+        m_times.assign(times.begin(), times.end());
+        m_values.assign(values.begin(), values.end());
+        m_interpolations.assign(count, Interpolation::Linear);
+        m_rightSlopes.assign(count, 0.0f);
+        m_nextLeftSlopes.assign(count, 0.0f);
+
+        // Key attributes are run length encoded, each shared by KeyAttrRefCount consecutive keys.
+        std::unique_ptr<Property> flagStorage;
+        std::unique_ptr<Property> dataStorage;
+        std::unique_ptr<Property> refCountStorage;
+        const Span<const int32_t> flags = arrayOf<int32_t>(curve, "KeyAttrFlags", flagStorage);
+        const Span<const float> data = arrayOf<float>(curve, "KeyAttrDataFloat", dataStorage);
+        const Span<const int32_t> refCounts = arrayOf<int32_t>(curve, "KeyAttrRefCount", refCountStorage);
+        if (data.size() < flags.size() * 4 || refCounts.size() < flags.size())
+        {
+            throw std::runtime_error("Animation curve key attributes are incomplete.");
+        }
+
+        size_t key = 0;
+        for (size_t attribute = 0; attribute < flags.size() && key < count; attribute++)
+        {
+            const uint32_t flag = static_cast<uint32_t>(flags[attribute]);
+            Interpolation interpolation = Interpolation::Linear;
+            if (flag & interpolationConstant)
+            {
+                interpolation = (flag & constantNext) ? Interpolation::ConstantNext : Interpolation::Constant;
+            }
+            else if (flag & interpolationCubic)
+            {
+                interpolation = Interpolation::Cubic;
+            }
+            else if (flag & interpolationLinear)
+            {
+                interpolation = Interpolation::Linear;
+            }
+
+            const size_t last = std::min(count, key + static_cast<size_t>(std::max(refCounts[attribute], 0)));
+            for (; key < last; key++)
+            {
+                m_interpolations[key] = interpolation;
+                m_rightSlopes[key] = data[attribute * 4];
+                m_nextLeftSlopes[key] = data[attribute * 4 + 1];
+            }
+        }
+
+        for (size_t i = 1; i < count; i++)
+        {
+            if (m_times[i] < m_times[i - 1])
+            {
+                throw std::runtime_error("Animation curve key times are not sorted.");
+            }
+        }
+    }
+
+    size_t AnimationCurve::size() const
+    {
+        return m_times.size();
+    }
+
+    Span<const int64_t> AnimationCurve::times() const
+    {
+        return Span<const int64_t>(m_times.data(), m_times.size());
+    }
+
+    Span<const float> AnimationCurve::values() const
+    {
+        return Span<const float>(m_values.data(), m_values.size());
+    }
+
+    Span<const AnimationCurve::Interpolation> AnimationCurve::interpolations() const
+    {
+        return Span<const Interpolation>(m_interpolations.data(), m_interpolations.size());
+    }
+
+    float AnimationCurve::evaluate(const int64_t time) const
+    {
+        float value;
+        sample(time, 1, 1, &value);
+        return value;
+    }
+
+    void AnimationCurve::sample(const int64_t start, const int64_t step, const size_t count, float * output) const
+    {
+        const size_t keyCount = m_times.size();
+        if (keyCount == 0)
+        {
+            std::fill(output, output + count, m_default);
+            return;
+        }
+
+        // Sample times only move forward, so walk the keys once and evaluate each segment in a tight loop.
+        size_t frame = 0;
+        size_t key = 0;
+        while (frame < count && start + static_cast<int64_t>(frame) * step <= m_times[0])
+        {
+            output[frame++] = m_values[0];
+        }
+        while (frame < count)
+        {
+            const int64_t time = start + static_cast<int64_t>(frame) * step;
+            while (key + 1 < keyCount && m_times[key + 1] <= time)
+            {
+                key++;
+            }
+            if (key + 1 >= keyCount)
+            {
+                std::fill(output + frame, output + count, m_values[keyCount - 1]);
+                return;
+            }
+
+            // Frames up to, but not including, the next key.
+            const int64_t time0 = m_times[key];
+            const int64_t time1 = m_times[key + 1];
+            const size_t segmentEnd = std::min(count, static_cast<size_t>((time1 - start + step - 1) / step));
+            const float value0 = m_values[key];
+            const float value1 = m_values[key + 1];
+            const double inverseDuration = 1.0 / static_cast<double>(time1 - time0);
+
+            switch (m_interpolations[key])
+            {
+                case Interpolation::Constant:
+                    std::fill(output + frame, output + segmentEnd, value0);
+                    break;
+                case Interpolation::ConstantNext:
+                    std::fill(output + frame, output + segmentEnd, value1);
+                    break;
+                case Interpolation::Linear:
+                    for (size_t i = frame; i < segmentEnd; i++)
+                    {
+                        const float u = static_cast<float>(static_cast<double>(start + static_cast<int64_t>(i) * step - time0) * inverseDuration);
+                        output[i] = value0 + (value1 - value0) * u;
+                    }
+                    break;
+                case Interpolation::Cubic:
+                {
+                    // Hermite basis, slopes are per second.
+                    const float duration = static_cast<float>(static_cast<double>(time1 - time0) / static_cast<double>(ticksPerSecond));
+                    const float tangent0 = m_rightSlopes[key] * duration;
+                    const float tangent1 = m_nextLeftSlopes[key] * duration;
+                    for (size_t i = frame; i < segmentEnd; i++)
+                    {
+                        const float u = static_cast<float>(static_cast<double>(start + static_cast<int64_t>(i) * step - time0) * inverseDuration);
+                        const float u2 = u * u;
+                        const float u3 = u2 * u;
+                        output[i] = (2.0f * u3 - 3.0f * u2 + 1.0f) * value0 + (u3 - 2.0f * u2 + u) * tangent0 +
+                            (3.0f * u2 - 2.0f * u3) * value1 + (u3 - u2) * tangent1;
+                    }
+                    break;
+                }
+            }
+            frame = std::max(segmentEnd, frame + 1);
+        }
+    }
+
+    BakedAnimation bakeAnimation(const Record & stack, const ObjectIndex & objects, const ConnectionGraph & connections, const double frameRate, const unsigned int threads)
+    {
+        if (stack.properties().size() == 0 || stack.properties().front()->type() != Property::Type::Integer64)
+        {
+            throw std::runtime_error("Animation stack is missing its uid.");
+        }
+        if (frameRate <= 0.0)
+        {
+            throw std::runtime_error("Frame rate must be positive.");
+        }
+
+        BakedAnimation result;
+        auto it = stack.find("Properties70");
+        const PropertyTable table = it != stack.end() ? PropertyTable(**it) : PropertyTable();
+        static const uint32_t localStart = PropertyTable::intern("LocalStart");
+        static const uint32_t localStop = PropertyTable::intern("LocalStop");
+        result.start = table.integer(localStart, 0);
+        const int64_t stop = std::max(result.start, table.integer(localStop, result.start));
+        result.step = std::max<int64_t>(1, static_cast<int64_t>(static_cast<double>(AnimationCurve::ticksPerSecond) / frameRate + 0.5));
+        result.frames = static_cast<uint32_t>((stop - result.start) / result.step + 1);
+
+        // Stack -> layers -> curve nodes, each bound to a node property and carrying one curve per component.
+        std::vector<const Record *> curves;
+        const int64_t stackUid = stack.properties().front()->get<int64_t>();
+        for (auto & layer : connections.children(stackUid))
+        {
+            if (isObject(objects.find(layer.uid), "AnimationLayer", "") == false)
+            {
+                continue;
+            }
+            for (auto & curveNode : connections.children(layer.uid))
+            {
+                if (isObject(objects.find(curveNode.uid), "AnimationCurveNode", "") == false)
+                {
+                    continue;
+                }
+
+                const ConnectionGraph::Connection * pTarget = nullptr;
+                for (auto & parent : connections.parents(curveNode.uid))
+                {
+                    if (parent.type == ConnectionGraph::Type::ObjectProperty)
+                    {
+                        pTarget = &parent;
+                        break;
+                    }
+                }
+                if (pTarget == nullptr)
+                {
+                    continue;
+                }
+
+                for (auto & curve : connections.children(curveNode.uid))
+                {
+                    const Record * pCurve = objects.find(curve.uid);
+                    if (curve.type != ConnectionGraph::Type::ObjectProperty || isObject(pCurve, "AnimationCurve", "") == false)
+                    {
+                        continue;
+                    }
+
+                    const std::string & component = connections.label(curve.parentProperty);
+                    BakedAnimation::Channel channel;
+                    channel.node = pTarget->uid;
+                    channel.property = connections.label(pTarget->parentProperty);
+                    channel.component = component.size() == 3 && component[0] == 'd' && component[1] == '|' && component[2] >= 'X' && component[2] <= 'Z' ?
+                        static_cast<uint32_t>(component[2] - 'X') : 0;
+                    result.channels.push_back(channel);
+                    curves.push_back(pCurve);
+                }
+            }
+        }
+
+        result.samples.resize(static_cast<size_t>(result.frames) * curves.size());
+        parallelFor(curves.size(), 1, threads, [&](const size_t begin, const size_t end)
+        {
+            AnimationCurve curve;
+            for (size_t i = begin; i < end; i++)
+            {
+                curve.load(*curves[i]);
+                curve.sample(result.start, result.step, result.frames, &result.samples[i * result.frames]);
+            }
+        });
+
+        return result;
+    }
+
+
+    // Scene transforms
+    namespace
+    {
+        // Column-major 4x4 matrices.
+        struct Matrix
+        {
+            double values[16];
+        };
+
+        Matrix identity()
+        {
+            Matrix result;
+            for (size_t i = 0; i < 16; i++)
+            {
+                result.values[i] = (i % 5) == 0 ? 1.0 : 0.0;
+            }
+            return result;
+        }
+
+        // Column by column, so every output column is a linear combination the compiler can vectorize.
+        Matrix multiply(const Matrix & a, const Matrix & b)
+        {
+            Matrix result;
+            for (size_t column = 0; column < 4; column++)
+            {
+                const double * pB = &b.values[column * 4];
+                double * pResult = &result.values[column * 4];
+                for (size_t row = 0; row < 4; row++)
+                {
+                    pResult[row] = a.values[row] * pB[0] + a.values[4 + row] * pB[1] + a.values[8 + row] * pB[2] + a.values[12 + row] * pB[3];
+                }
+            }
+            return result;
+        }
+
+        Matrix translation(const double vector[3])
+        {
+            Matrix result = identity();
+            result.values[12] = vector[0];
+            result.values[13] = vector[1];
+            result.values[14] = vector[2];
+            return result;
+        }
+
+        Matrix scaling(const double vector[3])
+        {
+            Matrix result = identity();
+            result.values[0] = vector[0];
+            result.values[5] = vector[1];
+            result.values[10] = vector[2];
+            return result;
+        }
+
+        Matrix axisRotation(const size_t axis, const double degrees)
+        {
+            const double radians = degrees * 3.14159265358979323846 / 180.0;
+            const double c = std::cos(radians);
+            const double s = std::sin(radians);
+            const size_t u = (axis + 1) % 3;
+            const size_t v = (axis + 2) % 3;
+            Matrix result = identity();
+            result.values[u * 4 + u] = c;
+            result.values[u * 4 + v] = s;
+            result.values[v * 4 + u] = -s;
+            result.values[v * 4 + v] = c;
+            return result;
+        }
+
+        // Euler rotation in FBX rotation order, the first named axis is applied first.
+        Matrix rotation(const double degrees[3], const int64_t order)
+        {
+            static const size_t axes[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 2, 0 }, { 1, 0, 2 }, { 2, 0, 1 }, { 2, 1, 0 } };
+            const size_t * pAxes = axes[order >= 0 && order < 6 ? order : 0];
+            Matrix result = axisRotation(pAxes[0], degrees[pAxes[0]]);
+            result = multiply(axisRotation(pAxes[1], degrees[pAxes[1]]), result);
+            return multiply(axisRotation(pAxes[2], degrees[pAxes[2]]), result);
+        }
+
+        Matrix transpose(const Matrix & matrix)
+        {
+            Matrix result;
+            for (size_t row = 0; row < 4; row++)
+            {
+                for (size_t column = 0; column < 4; column++)
+                {
+                    result.values[column * 4 + row] = matrix.values[row * 4 + column];
+                }
+            }
+            return result;
+        }
+
+        struct TransformNames
+        {
+            TransformNames() :
+                translation(PropertyTable::intern("Lcl Translation")),
+                rotation(PropertyTable::intern("Lcl Rotation")),
+                scaling(PropertyTable::intern("Lcl Scaling")),
+                preRotation(PropertyTable::intern("PreRotation")),
+                postRotation(PropertyTable::intern("PostRotation")),
+                rotationOffset(PropertyTable::intern("RotationOffset")),
+                rotationPivot(PropertyTable::intern("RotationPivot")),
+                scalingOffset(PropertyTable::intern("ScalingOffset")),
+                scalingPivot(PropertyTable::intern("ScalingPivot")),
+                rotationOrder(PropertyTable::intern("RotationOrder"))
+            {}
+
+            uint32_t translation;
+            uint32_t rotation;
+            uint32_t scaling;
+            uint32_t preRotation;
+            uint32_t postRotation;
+            uint32_t rotationOffset;
+            uint32_t rotationPivot;
+            uint32_t scalingOffset;
+            uint32_t scalingPivot;
+            uint32_t rotationOrder;
+        };
+
+        // T * Roff * Rp * Rpre * R * Rpost^-1 * Rp^-1 * Soff * Sp * S * Sp^-1
+        Matrix localTransform(const PropertyTable & table, const TransformNames & names)
+        {
+            auto vector = [&table](const uint32_t name, const double defaultValue, double values[3])
+            {
+                if (table.vector(name, values) == false)
+                {
+                    values[0] = values[1] = values[2] = defaultValue;
+                }
+            };
+
+            double translationValue[3], rotationValue[3], scalingValue[3];
+            double preRotation[3], postRotation[3];
+            double rotationOffset[3], rotationPivot[3], scalingOffset[3], scalingPivot[3];
+            vector(names.translation, 0.0, translationValue);
+            vector(names.rotation, 0.0, rotationValue);
+            vector(names.scaling, 1.0, scalingValue);
+            vector(names.preRotation, 0.0, preRotation);
+            vector(names.postRotation, 0.0, postRotation);
+            vector(names.rotationOffset, 0.0, rotationOffset);
+            vector(names.rotationPivot, 0.0, rotationPivot);
+            vector(names.scalingOffset, 0.0, scalingOffset);
+            vector(names.scalingPivot, 0.0, scalingPivot);
+            const int64_t order = table.integer(names.rotationOrder, 0);
+
+            const double negativeRotationPivot[3] = { -rotationPivot[0], -rotationPivot[1], -rotationPivot[2] };
+            const double negativeScalingPivot[3] = { -scalingPivot[0], -scalingPivot[1], -scalingPivot[2] };
+
+            Matrix result = translation(translationValue);
+            result = multiply(result, translation(rotationOffset));
+            result = multiply(result, translation(rotationPivot));
+            result = multiply(result, rotation(preRotation, 0));
+            result = multiply(result, rotation(rotationValue, order));
+            result = multiply(result, transpose(rotation(postRotation, 0)));
+            result = multiply(result, translation(negativeRotationPivot));
+            result = multiply(result, translation(scalingOffset));
+            result = multiply(result, translation(scalingPivot));
+            result = multiply(result, scaling(scalingValue));
+            return multiply(result, translation(negativeScalingPivot));
+        }
+    }
+
+    SceneTransforms evaluateTransforms(const Record & file, const ConnectionGraph & connections, const unsigned int threads)
+    {
+        SceneTransforms result;
+
+        auto objectsIt = file.find("Objects");
+        if (objectsIt == file.end())
+        {
+            return result;
+        }
+
+        // Model property template from the definitions.
+        const Record * pTemplate = nullptr;
+        auto definitionsIt = file.find("Definitions");
+        if (definitionsIt != file.end())
+        {
+            for (auto pObjectType : **definitionsIt)
+            {
+                if (isObject(pObjectType, "ObjectType", "") && pObjectType->properties().size() && pObjectType->properties().front()->string() == "Model")
+                {
+                    auto templateIt = pObjectType->find("PropertyTemplate");
+                    pTemplate = templateIt != pObjectType->end() ? *templateIt : nullptr;
+                }
+            }
+        }
+        // Built here on the calling thread, the workers below only read it.
+        const PropertyTable defaults = pTemplate != nullptr ? PropertyTable(*pTemplate) : PropertyTable();
+
+        std::vector<const Record *> models;
+        std::unordered_map<int64_t, int32_t> indices;
+        for (auto pObject : **objectsIt)
+        {
+            if (isObject(pObject, "Model", "") && pObject->properties().size() && pObject->properties().front()->type() == Property::Type::Integer64)
+            {
+                const int64_t uid = pObject->properties().front()->get<int64_t>();
+                if (indices.insert(std::make_pair(uid, static_cast<int32_t>(models.size()))).second)
+                {
+                    models.push_back(pObject);
+                    result.nodes.push_back(uid);
+                }
+            }
+        }
+        const size_t count = models.size();
+
+        result.parents.assign(count, -1);
+        for (size_t i = 0; i < count; i++)
+        {
+            for (auto & parent : connections.parents(result.nodes[i]))
+            {
+                auto it = indices.find(parent.uid);
+                if (parent.type == ConnectionGraph::Type::ObjectObject && it != indices.end())
+                {
+                    result.parents[i] = it->second;
+                    break;
+                }
+            }
+        }
+
+        // Depth of every node, then a counting sort into levels where all parents precede their children.
+        std::vector<int32_t> depths(count, -1);
+        std::vector<size_t> chain;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t node = i;
+            while (depths[node] < 0 && result.parents[node] >= 0)
+            {
+                chain.push_back(node);
+                node = static_cast<size_t>(result.parents[node]);
+                if (chain.size() > count)
+                {
+                    throw std::runtime_error("Model hierarchy contains a cycle.");
+                }
+            }
+            int32_t depth = depths[node] < 0 ? 0 : depths[node];
+            depths[node] = depth;
+            while (chain.size())
+            {
+                depths[chain.back()] = ++depth;
+                chain.pop_back();
+            }
+        }
+
+        const size_t levelCount = count ? static_cast<size_t>(*std::max_element(depths.begin(), depths.end())) + 1 : 0;
+        std::vector<size_t> levelOffsets(levelCount + 1, 0);
+        for (auto depth : depths)
+        {
+            levelOffsets[depth + 1]++;
+        }
+        for (size_t level = 0; level < levelCount; level++)
+        {
+            levelOffsets[level + 1] += levelOffsets[level];
+        }
+        std::vector<size_t> order(count);
+        std::vector<size_t> cursors(levelOffsets.begin(), levelOffsets.end() - 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            order[cursors[depths[i]]++] = i;
+        }
+
+        // Local matrices are independent; world matrices only depend on the previous level.
+        const TransformNames names;
+        const size_t grain = 1024;
+        result.local.resize(count * 16);
+        result.world.resize(count * 16);
+        parallelFor(count, grain, threads, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                auto it = models[i]->find("Properties70");
+                const PropertyTable table = it != models[i]->end() ? PropertyTable(**it, &defaults) : PropertyTable(*models[i], &defaults);
+                const Matrix local = localTransform(table, names);
+                std::copy(local.values, local.values + 16, &result.local[i * 16]);
+            }
+        });
+
+        for (size_t level = 0; level < levelCount; level++)
+        {
+            parallelFor(levelOffsets[level + 1] - levelOffsets[level], grain, threads, [&](const size_t begin, const size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const size_t node = order[levelOffsets[level] + i];
+                    double * pWorld = &result.world[node * 16];
+                    const double * pLocal = &result.local[node * 16];
+                    const int32_t parent = result.parents[node];
+                    if (parent < 0)
+                    {
+                        std::copy(pLocal, pLocal + 16, pWorld);
+                        continue;
+                    }
+
+                    Matrix parentWorld;
+                    Matrix local;
+                    std::copy(&result.world[parent * 16], &result.world[parent * 16] + 16, parentWorld.values);
+                    std::copy(pLocal, pLocal + 16, local.values);
+                    const Matrix world = multiply(parentWorld, local);
+                    std::copy(world.values, world.values + 16, pWorld);
+                }
+            });
+        }
+
+        return result;
+    }
+
+
+    // Embedded media
+    std::vector<EmbeddedMedia> listEmbeddedMedia(const std::string & filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (file.is_open() == false)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+
+        std::vector<EmbeddedMedia> media;
+        EmbeddedMedia current;
+        bool inObjects = false;
+        bool inVideo = false;
+        std::string recordName;
+        size_t propertyIndex = 0;
+
+        auto finishVideo = [&]()
+        {
+            if (inVideo && current.size)
+            {
+                media.push_back(current);
+            }
+            inVideo = false;
+        };
+        auto readString = [&file](const PropertyHeader & header)
+        {
+            std::string value(header.size, '\0');
+            file.seekg(static_cast<std::streamoff>(header.offset));
+            file.read(&value[0], header.size);
+            return value;
+        };
+
+        // Only the Video records below Objects are of interest; their payloads are never read.
+        StructureScanner scanner(file);
+        scanner.readHeader();
+        scanner.scan(
+            [&](const std::string & name, const size_t depth, const uint64_t)
+            {
+                if (depth <= 1)
+                {
+                    finishVideo();
+                }
+                if (depth == 0)
+                {
+                    inObjects = name == "Objects";
+                }
+                else if (depth == 1 && inObjects && name == "Video")
+                {
+                    current = EmbeddedMedia{ 0, std::string(), std::string(), 0, 0 };
+                    inVideo = true;
+                }
+                recordName = depth == 1 || (depth == 2 && inVideo) ? name : std::string();
+                propertyIndex = 0;
+            },
+            [&](const PropertyHeader & header)
+            {
+                const size_t index = propertyIndex++;
+                if (inVideo == false)
+                {
+                    return;
+                }
+
+                if (recordName == "Video")
+                {
+                    if (index == 0 && header.type == Property::Type::Integer64)
+                    {
+                        file.seekg(static_cast<std::streamoff>(header.offset));
+                        file.read(reinterpret_cast<char*>(&current.uid), 8);
+                    }
+                    else if (index == 1 && header.type == Property::Type::String)
+                    {
+                        const std::string name = readString(header);
+                        current.name = name.substr(0, name.find(std::string("\x00\x01", 2)));
+                    }
+                }
+                else if (index == 0 && header.type == Property::Type::Raw && recordName == "Content")
+                {
+                    current.offset = header.offset;
+                    current.size = header.size;
+                }
+                else if (index == 0 && header.type == Property::Type::String &&
+                    (recordName == "RelativeFilename" || (recordName == "Filename" && current.filename.empty())))
+                {
+                    current.filename = readString(header);
+                }
+            });
+        finishVideo();
+
+        return media;
+    }
+
+    void extractEmbeddedMedia(const std::string & filename, const EmbeddedMedia & media, const int fd)
+    {
+#if defined(_WIN32)
+        const int input = _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        const int input = open(filename.c_str(), O_RDONLY);
+#endif
+        if (input < 0)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+
+        struct Closer
+        {
+            ~Closer()
+            {
+#if defined(_WIN32)
+                _close(descriptor);
+#else
+                close(descriptor);
+#endif
+            }
+            int descriptor;
+        } closer = { input };
+
+        uint64_t offset = media.offset;
+        uint64_t remaining = media.size;
+
+#if defined(__linux__)
+        // Let the kernel move the bytes, trying copy_file_range first and sendfile for destinations it refuses.
+        bool useSendfile = false;
+        while (remaining)
+        {
+            const size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, 1U << 30));
+            ssize_t copied = -1;
+            if (useSendfile == false)
+            {
+                loff_t inputOffset = static_cast<loff_t>(offset);
+                copied = copy_file_range(input, &inputOffset, fd, nullptr, count, 0);
+                if (copied < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EBADF || errno == EOPNOTSUPP))
+                {
+                    useSendfile = true;
+                    continue;
+                }
+            }
+            else
+            {
+                off_t inputOffset = static_cast<off_t>(offset);
+                copied = sendfile(fd, input, &inputOffset, count);
+                if (copied < 0 && (errno == EINVAL || errno == ENOSYS))
+                {
+                    break;
+                }
+            }
+
+            if (copied < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (copied <= 0)
+            {
+                throw std::runtime_error("Failed to copy embedded media.");
+            }
+            offset += static_cast<uint64_t>(copied);
+            remaining -= static_cast<uint64_t>(copied);
+        }
+#endif
+
+        // Portable fallback through a fixed size buffer.
+        if (remaining)
+        {
+            std::ifstream file(filename, std::ios::binary);
+            file.seekg(static_cast<std::streamoff>(offset));
+            std::unique_ptr<char[]> pBuffer(new char[64 * 1024]);
+            while (remaining)
+            {
+                const size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, 64 * 1024));
+                file.read(pBuffer.get(), count);
+                if (file.good() == false)
+                {
+                    throw std::runtime_error("Unexpected end of file.");
+                }
+
+                size_t written = 0;
+                while (written < count)
+                {
+#if defined(_WIN32)
+                    const int result = _write(fd, pBuffer.get() + written, static_cast<unsigned int>(count - written));
+#else
+                    const ssize_t result = write(fd, pBuffer.get() + written, count - written);
+#endif
+                    if (result <= 0)
+                    {
+                        throw std::runtime_error("Failed to write embedded media.");
+                    }
+                    written += static_cast<size_t>(result);
+                }
+                remaining -= count;
+            }
+        }
+    }
+
+
+    // Snapshot
+    namespace
+    {
+        // Snapshots start with a header followed by the node, property and name tables, then the
+        // name bytes and the property payloads. Offsets are relative to the start of the snapshot,
+        // tables and payloads are 64 byte aligned. Nodes are stored breadth first, so the children
+        // of a node are a contiguous range, as are its properties.
+        const char snapshotMagic[8] = { 'F', 'B', 'X', 'S', 'N', 'A', 'P', '\0' };
+        const uint32_t snapshotVersion = 1;
+        const uint64_t snapshotAlignment = 64;
+        const uint32_t snapshotNoParent = 0xFFFFFFFF;
+
+        struct SnapshotHeader
+        {
+            char        magic[8];
+            uint32_t    version;
+            uint32_t    nodeCount;
+            uint32_t    propertyCount;
+            uint32_t    nameCount;
+            uint64_t    size;
+            uint64_t    nodes;
+            uint64_t    properties;
+            uint64_t    names;
+            uint64_t    reserved;
+        };
+
+        struct SnapshotNode
+        {
+            uint32_t    name;
+            uint32_t    parent;
+            uint32_t    firstChild;
+            uint32_t    childCount;
+            uint32_t    firstProperty;
+            uint32_t    propertyCount;
+        };
+
+        struct SnapshotProperty
+        {
+            uint8_t     type;
+            uint8_t     reserved[3];
+            uint32_t    size;       // Array length, or byte count of strings and raw data.
+            uint64_t    value;      // Primitive value, or payload offset.
+        };
+
+        struct SnapshotName
+        {
+            uint64_t    offset;     // Null terminated.
+            uint32_t    length;
+            uint32_t    reserved;
+        };
+
+        static_assert(sizeof(SnapshotHeader) == 64, "Unexpected snapshot header size.");
+        static_assert(sizeof(SnapshotNode) == 24, "Unexpected snapshot node size.");
+        static_assert(sizeof(SnapshotProperty) == 16, "Unexpected snapshot property size.");
+        static_assert(sizeof(SnapshotName) == 16, "Unexpected snapshot name size.");
+
+        uint64_t alignSnapshot(const uint64_t offset)
+        {
+            return (offset + snapshotAlignment - 1) & ~(snapshotAlignment - 1);
+        }
+    }
+
+    Snapshot::Snapshot() :
+        m_pData(nullptr),
+        m_size(0),
+        m_pMapping(nullptr),
+        m_nodeCount(0),
+        m_propertyCount(0),
+        m_nameCount(0)
+    {
+    }
+
+    Snapshot::Snapshot(const std::string & filename) :
+        Snapshot()
+    {
+        open(filename);
+    }
+
+    Snapshot::Snapshot(const void * data, const size_t size) :
+        Snapshot()
+    {
+        open(data, size);
+    }
+
+    Snapshot::~Snapshot()
+    {
+        close();
+    }
+
+    void Snapshot::open(const std::string & filename)
+    {
+        close();
+
+#if defined(_WIN32)
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (file.is_open() == false)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+        const size_t size = static_cast<size_t>(file.tellg());
+        m_pMapping = ::operator new(size);
+        m_size = size;
+        file.seekg(0);
+        file.read(static_cast<char *>(m_pMapping), size);
+        if (file.good() == false)
+        {
+            close();
+            throw std::runtime_error("Failed to read snapshot.");
+        }
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+        {
+            ::close(fd);
+            throw std::runtime_error("Invalid snapshot.");
+        }
+        const size_t size = static_cast<size_t>(status.st_size);
+        void * pMapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (pMapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map snapshot.");
+        }
+        m_pMapping = pMapping;
+        m_size = size;
+#endif
+
+        try
+        {
+            attach(static_cast<const uint8_t *>(m_pMapping), m_size);
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+    }
+
+    void Snapshot::open(const void * data, const size_t size)
+    {
+        close();
+        attach(static_cast<const uint8_t *>(data), size);
+    }
+
+    void Snapshot::close()
+    {
+        if (m_pMapping != nullptr)
+        {
+#if defined(_WIN32)
+            ::operator delete(m_pMapping);
+#else
+            munmap(m_pMapping, m_size);
+#endif
+        }
+        m_pData = nullptr;
+        m_size = 0;
+        m_pMapping = nullptr;
+        m_nodeCount = 0;
+        m_propertyCount = 0;
+        m_nameCount = 0;
+    }
+
+    bool Snapshot::isOpen() const
+    {
+        return m_pData != nullptr;
+    }
+
+    size_t Snapshot::size() const
+    {
+        return m_size;
+    }
+
+    RecordView Snapshot::root() const
+    {
+        if (m_pData == nullptr)
+        {
+            throw std::runtime_error("Snapshot is not open.");
+        }
+        return RecordView(this, 0);
+    }
+
+    // Only the header and table extents are checked here, everything else when accessed.
+    void Snapshot::attach(const uint8_t * data, const size_t size)
+    {
+        if (data == nullptr || size < sizeof(SnapshotHeader) || reinterpret_cast<uintptr_t>(data) % 8 != 0)
+        {
+            throw std::runtime_error("Invalid snapshot, expecting at least a header at an 8 byte aligned address.");
+        }
+
+        const SnapshotHeader * pHeader = reinterpret_cast<const SnapshotHeader *>(data);
+        if (memcmp(pHeader->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || pHeader->version != snapshotVersion)
+        {
+            throw std::runtime_error("Invalid snapshot header.");
+        }
+        if (pHeader->size != size || pHeader->nodeCount == 0 ||
+            pHeader->nodes % 8 || pHeader->properties % 8 || pHeader->names % 8 ||
+            pHeader->nodes > size || (size - pHeader->nodes) / sizeof(SnapshotNode) < pHeader->nodeCount ||
+            pHeader->properties > size || (size - pHeader->properties) / sizeof(SnapshotProperty) < pHeader->propertyCount ||
+            pHeader->names > size || (size - pHeader->names) / sizeof(SnapshotName) < pHeader->nameCount)
+        {
+            throw std::runtime_error("Snapshot tables exceeding snapshot size.");
+        }
+
+        m_pData = data;
+        m_size = size;
+        m_nodeCount = pHeader->nodeCount;
+        m_propertyCount = pHeader->propertyCount;
+        m_nameCount = pHeader->nameCount;
+    }
+
+    const void * Snapshot::node(const uint32_t index) const
+    {
+        if (index >= m_nodeCount)
+        {
+            throw std::runtime_error("Snapshot node index out of range.");
+        }
+        const SnapshotHeader * pHeader = reinterpret_cast<const SnapshotHeader *>(m_pData);
+        return m_pData + pHeader->nodes + static_cast<uint64_t>(index) * sizeof(SnapshotNode);
+    }
+
+    const void * Snapshot::property(const uint32_t index) const
+    {
+        if (index >= m_propertyCount)
+        {
+            throw std::runtime_error("Snapshot property index out of range.");
+        }
+        const SnapshotHeader * pHeader = reinterpret_cast<const SnapshotHeader *>(m_pData);
+        return m_pData + pHeader->properties + static_cast<uint64_t>(index) * sizeof(SnapshotProperty);
+    }
+
+    const char * Snapshot::name(const uint32_t index) const
+    {
+        if (index >= m_nameCount)
+        {
+            throw std::runtime_error("Snapshot name index out of range.");
+        }
+        const SnapshotHeader * pHeader = reinterpret_cast<const SnapshotHeader *>(m_pData);
+        const SnapshotName & name = reinterpret_cast<const SnapshotName *>(m_pData + pHeader->names)[index];
+        const char * pName = reinterpret_cast<const char *>(payload(name.offset, static_cast<uint64_t>(name.length) + 1));
+        if (pName[name.length] != '\0')
+        {
+            throw std::runtime_error("Snapshot name is not terminated.");
+        }
+        return pName;
+    }
+
+    const uint8_t * Snapshot::payload(const uint64_t offset, const uint64_t size) const
+    {
+        if (offset > m_size || size > m_size - offset)
+        {
+            throw std::runtime_error("Snapshot payload exceeding snapshot size.");
+        }
+        return m_pData + offset;
+    }
+
+    RecordView::RecordView(const Snapshot * snapshot, const uint32_t index) :
+        m_pSnapshot(snapshot),
+        m_index(index)
+    {
+    }
+
+    const char * RecordView::name() const
+    {
+        return m_pSnapshot->name(static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index))->name);
+    }
+
+    bool RecordView::hasParent() const
+    {
+        return static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index))->parent != snapshotNoParent;
+    }
+
+    RecordView RecordView::parent() const
+    {
+        const uint32_t parent = static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index))->parent;
+        if (parent == snapshotNoParent)
+        {
+            throw std::runtime_error("Record view has no parent.");
+        }
+        return RecordView(m_pSnapshot, parent);
+    }
+
+    ViewRange<PropertyView> RecordView::properties() const
+    {
+        const SnapshotNode * pNode = static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index));
+        return ViewRange<PropertyView>(m_pSnapshot, pNode->firstProperty, pNode->propertyCount);
+    }
+
+    size_t RecordView::size() const
+    {
+        return static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index))->childCount;
+    }
+
+    RecordView::Iterator RecordView::begin() const
+    {
+        return children().begin();
+    }
+
+    RecordView::Iterator RecordView::end() const
+    {
+        return children().end();
+    }
+
+    RecordView RecordView::front() const
+    {
+        return children().front();
+    }
+
+    RecordView RecordView::back() const
+    {
+        return children().back();
+    }
+
+    RecordView::Iterator RecordView::find(const std::string & p_name) const
+    {
+        const ViewRange<RecordView> range = children();
+        for (auto it = range.begin(); it != range.end(); ++it)
+        {
+            if (p_name == (*it).name())
+            {
+                return it;
+            }
+        }
+        return range.end();
+    }
+
+    ViewRange<RecordView> RecordView::children() const
+    {
+        const SnapshotNode * pNode = static_cast<const SnapshotNode *>(m_pSnapshot->node(m_index));
+        return ViewRange<RecordView>(m_pSnapshot, pNode->firstChild, pNode->childCount);
+    }
+
+    PropertyView::PropertyView(const Snapshot * snapshot, const uint32_t index) :
+        m_pSnapshot(snapshot),
+        m_index(index)
+    {
+    }
+
+    Property::Type PropertyView::type() const
+    {
+        const uint8_t type = static_cast<const SnapshotProperty *>(m_pSnapshot->property(m_index))->type;
+        if (type >= typeCount)
+        {
+            throw std::runtime_error("Invalid snapshot property type.");
+        }
+        return static_cast<Property::Type>(type);
+    }
+
+    uint8_t PropertyView::code() const
+    {
+        return typeInfos[static_cast<size_t>(type())].code;
+    }
+
+    uint32_t PropertyView::size() const
+    {
+        if (isPrimitive())
+        {
+            return static_cast<uint32_t>(elementSize(type()));
+        }
+        return static_cast<const SnapshotProperty *>(m_pSnapshot->property(m_index))->size;
+    }
+
+    Property::Value PropertyView::primitive() const
+    {
+        Property::Value value;
+        value.integer64 = 0;
+        if (isPrimitive())
+        {
+            memcpy(&value, &static_cast<const SnapshotProperty *>(m_pSnapshot->property(m_index))->value, sizeof(value));
+        }
+        return value;
+    }
+
+    Property::ValueArray PropertyView::array() const
+    {
+        if (isArray() == false)
+        {
+            return Property::ValueArray(type(), nullptr, 0);
+        }
+        return Property::ValueArray(type(), static_cast<const uint8_t *>(data()), size());
+    }
+
+    std::string PropertyView::string() const
+    {
+        const Span<const uint8_t> bytes = raw();
+        return propertyString(type(), primitive(), bytes.data(), static_cast<uint32_t>(bytes.size()));
+    }
+
+    Span<const uint8_t> PropertyView::raw() const
+    {
+        if (isString() == false && isRaw() == false)
+        {
+            return Span<const uint8_t>();
+        }
+        return Span<const uint8_t>(static_cast<const uint8_t *>(data()), size());
+    }
+
+    const void * PropertyView::data() const
+    {
+        const SnapshotProperty * pProperty = static_cast<const SnapshotProperty *>(m_pSnapshot->property(m_index));
+        if (isPrimitive())
+        {
+            return &pProperty->value;
+        }
+
+        const size_t element = elementSize(type());
+        if (pProperty->value % element != 0)
+        {
+            throw std::runtime_error("Misaligned snapshot array.");
+        }
+        return m_pSnapshot->payload(pProperty->value, static_cast<uint64_t>(pProperty->size) * element);
+    }
+
+    bool PropertyView::isPrimitive() const
+    {
+        return type() <= Property::Type::Float64;
+    }
+
+    bool PropertyView::isArray() const
+    {
+        return type() >= Property::Type::BooleanArray && type() <= Property::Type::Float64Array;
+    }
+
+    bool PropertyView::isString() const
+    {
+        return type() == Property::Type::String;
+    }
+
+    bool PropertyView::isRaw() const
+    {
+        return type() == Property::Type::Raw;
+    }
+
+    void PropertyView::checkType(const Property::Type p_type) const
+    {
+        if (type() != p_type)
+        {
+            throw std::runtime_error("Property type mismatch, expected '" + std::string(1, static_cast<char>(typeInfos[static_cast<size_t>(p_type)].code)) +
+                "' but property is '" + std::string(1, static_cast<char>(code())) + "'.");
+        }
+    }
+
+
+    // Document
+    Document::Document(Record * record) :
+        m_pRoot(record),
+        m_usage(0),
+        m_inflatedUsage(0)
+    {
+        if (record == nullptr || record->parent() != nullptr)
+        {
+            m_pRoot.release();
+            throw std::runtime_error("Documents are created from root records.");
+        }
+        freeze();
+    }
+
+    Document::Document(const std::string & filename, const ReadOptions & options) :
+        m_pRoot(new Record),
+        m_usage(0),
+        m_inflatedUsage(0)
+    {
+        m_pRoot->read(filename, options);
+        freeze();
+    }
+
+    Document::~Document()
+    {
+        for (auto & encoded : m_encoded)
+        {
+            uint8_t * pData = m_pInflated[encoded.second].load(std::memory_order_relaxed);
+            if (pData != nullptr)
+            {
+                encoded.first->resource()->deallocate(pData, elementSize(encoded.first->type()) * encoded.first->size(), alignof(std::max_align_t));
+            }
+        }
+    }
+
+    // Removes every lazily mutated state from the tree, so the const Record API only reads afterwards:
+    // paged arrays are made resident and the cached memory usage is computed. Encoded arrays are kept
+    // as they are and inflated on first access through the document.
+    void Document::freeze()
+    {
+        std::vector<Record *> records(1, m_pRoot.get());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            for (Property * pProperty : records[i]->properties())
+            {
+                if (pProperty->isPaged())
+                {
+                    pProperty->data();
+                }
+                if (pProperty->isEncoded())
+                {
+                    const size_t index = m_encoded.size();
+                    m_encoded[pProperty] = index;
+                }
+            }
+            for (Record * pChild : *records[i])
+            {
+                records.push_back(pChild);
+            }
+        }
+
+        m_pInflated.reset(new std::atomic<uint8_t *>[m_encoded.size()]());
+        m_usage = m_pRoot->memoryUsage();
+    }
+
+    const Record & Document::root() const
+    {
+        return *m_pRoot;
+    }
+
+    // Concurrent first accesses may each inflate the array, only the first one to publish is kept
+    // and the others release their copy, so readers never wait on a lock.
+    const void * Document::data(const Property & property) const
+    {
+        if (property.isEncoded() == false)
+        {
+            return property.data();
+        }
+
+        auto it = m_encoded.find(&property);
+        if (it == m_encoded.end())
+        {
+            throw std::runtime_error("Property does not belong to the document.");
+        }
+        std::atomic<uint8_t *> & published = m_pInflated[it->second];
+        uint8_t * pData = published.load(std::memory_order_acquire);
+        if (pData != nullptr)
+        {
+            return pData;
+        }
+
+        const size_t size = elementSize(property.type()) * property.size();
+        if (size == 0)
+        {
+            return nullptr;
+        }
+
+        FBX_TRACE_SCOPE("inflate", std::to_string(size) + " bytes");
+        MemoryResource * pResource = property.resource();
+        const Span<const uint8_t> payload = property.encoded();
+        t_allocations += 1;
+        uint8_t * pInflated = static_cast<uint8_t *>(pResource->allocate(size, alignof(std::max_align_t)));
+        mz_ulong inflatedLength = static_cast<mz_ulong>(size);
+        if (uncompress(pInflated, &inflatedLength, payload.data(), static_cast<mz_ulong>(payload.size())) != MZ_OK || inflatedLength != size)
+        {
+            pResource->deallocate(pInflated, size, alignof(std::max_align_t));
+            throw std::runtime_error("Failed to uncompress array property.");
+        }
+
+        if (published.compare_exchange_strong(pData, pInflated, std::memory_order_acq_rel, std::memory_order_acquire) == false)
+        {
+            pResource->deallocate(pInflated, size, alignof(std::max_align_t));
+            return pData;
+        }
+        m_inflatedUsage.fetch_add(size, std::memory_order_relaxed);
+        return pInflated;
+    }
+
+    Property::ValueArray Document::array(const Property & property) const
+    {
+        if (property.isArray() == false)
+        {
+            return Property::ValueArray(property.type(), nullptr, 0);
+        }
+        return Property::ValueArray(property.type(), static_cast<const uint8_t *>(data(property)), property.size());
+    }
+
+    size_t Document::memoryUsage() const
+    {
+        return m_usage + m_inflatedUsage.load(std::memory_order_relaxed);
+    }
+
+    void Document::checkType(const Property & property, const Property::Type type) const
+    {
+        if (property.type() != type)
+        {
+            throw std::runtime_error("Property type mismatch, expected '" + std::string(1, static_cast<char>(typeInfos[static_cast<size_t>(type)].code)) +
+                "' but property is '" + std::string(1, static_cast<char>(property.code())) + "'.");
+        }
+    }
+
+
+    // Document cache
+    DocumentCache::DocumentCache(const size_t capacity, const ReadOptions & options) :
+        m_capacity(capacity),
+        m_options(options),
+        m_usage(0),
+        m_generation(0)
+    {
+        // Loads run concurrently, so they do not share a statistics object and the callbacks are serialized.
+        // Statistics of each load are still reported through onStatistics.
+        m_options.statistics = nullptr;
+        if (options.onHeaderRead)
+        {
+            m_options.onHeaderRead = [this, options](std::string magic, uint32_t version)
+            {
+                std::lock_guard<std::mutex> lock(m_callbackMutex);
+                options.onHeaderRead(magic, version);
+            };
+        }
+        if (options.onStatistics)
+        {
+            m_options.onStatistics = [this, options](const Statistics & statistics)
+            {
+                std::lock_guard<std::mutex> lock(m_callbackMutex);
+                options.onStatistics(statistics);
+            };
+        }
+        if (options.onProgress)
+        {
+            m_options.onProgress = [this, options](uint64_t processed, uint64_t total)
+            {
+                std::lock_guard<std::mutex> lock(m_callbackMutex);
+                return options.onProgress(processed, total);
+            };
+        }
+    }
+
+    // Loads are single flight: the first caller for a path parses it while later callers wait on the
+    // same future. The file is identified before reading, so a change during the read is seen by the next load.
+    std::shared_ptr<const Document> DocumentCache::load(const std::string & filename)
+    {
+        Identity identity;
+#if defined(_WIN32)
+        struct _stat64 status;
+        if (_stat64(filename.c_str(), &status) != 0)
+#else
+        struct stat status;
+        if (stat(filename.c_str(), &status) != 0)
+#endif
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+        identity.size = static_cast<uint64_t>(status.st_size);
+#if defined(__linux__)
+        identity.modified = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+        identity.modified = static_cast<int64_t>(status.st_mtimespec.tv_sec) * 1000000000 + status.st_mtimespec.tv_nsec;
+#else
+        identity.modified = static_cast<int64_t>(status.st_mtime) * 1000000000;
+#endif
+        identity.inode = static_cast<uint64_t>(status.st_ino);
+        identity.device = static_cast<uint64_t>(status.st_dev);
+
+        std::promise<std::shared_ptr<const Document>> promise;
+        uint64_t generation = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(filename);
+            if (it != m_entries.end())
+            {
+                const Identity & cached = it->second.identity;
+                if (cached.size == identity.size && cached.modified == identity.modified &&
+                    cached.inode == identity.inode && cached.device == identity.device)
+                {
+                    m_recent.splice(m_recent.begin(), m_recent, it->second.recent);
+                    std::shared_future<std::shared_ptr<const Document>> document = it->second.document;
+                    evict();
+                    lock.unlock();
+                    return document.get();
+                }
+
+                m_usage -= it->second.usage;
+                m_recent.erase(it->second.recent);
+                m_entries.erase(it);
+            }
+
+            generation = ++m_generation;
+            m_recent.push_front(filename);
+            Entry & entry = m_entries[filename];
+            entry.identity = identity;
+            entry.generation = generation;
+            entry.document = promise.get_future().share();
+            entry.usage = 0;
+            entry.recent = m_recent.begin();
+        }
+
+        std::shared_ptr<const Document> document;
+        size_t usage = 0;
+        try
+        {
+            std::shared_ptr<Document> pDocument = std::make_shared<Document>(filename, m_options);
+            usage = std::max<size_t>(pDocument->memoryUsage(), 1);
+            document = pDocument;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(filename);
+            if (it != m_entries.end() && it->second.generation == generation)
+            {
+                m_recent.erase(it->second.recent);
+                m_entries.erase(it);
+            }
+            throw;
+        }
+
+        promise.set_value(document);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(filename);
+        if (it != m_entries.end() && it->second.generation == generation)
+        {
+            it->second.usage = usage;
+            m_usage += usage;
+            evict();
+        }
+        return document;
+    }
+
+    size_t DocumentCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    size_t DocumentCache::capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t DocumentCache::memoryUsage() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t usage = 0;
+        for (auto & entry : m_entries)
+        {
+            usage += entry.second.usage != 0 ? std::max<size_t>(entry.second.document.get()->memoryUsage(), 1) : 0;
+        }
+        return usage;
+    }
+
+    void DocumentCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_recent.clear();
+        m_usage = 0;
+    }
+
+    // Drops least recently used documents until the loaded ones fit, skipping those still loading.
+    // Handles already returned stay valid, eviction only releases the cache's reference.
+    void DocumentCache::evict()
+    {
+        // Documents grow as they inflate deferred arrays, so their usage is read again on every check.
+        m_usage = 0;
+        for (auto & entry : m_entries)
+        {
+            if (entry.second.usage != 0)
+            {
+                entry.second.usage = std::max<size_t>(entry.second.document.get()->memoryUsage(), 1);
+                m_usage += entry.second.usage;
+            }
+        }
+
+        auto recent = m_recent.end();
+        while (m_usage > m_capacity && recent != m_recent.begin())
+        {
+            --recent;
+            auto it = m_entries.find(*recent);
+            if (it->second.usage == 0)
+            {
+                continue;
+            }
+
+            m_usage -= it->second.usage;
+            m_entries.erase(it);
+            recent = m_recent.erase(recent);
+        }
+    }
+
+
+    // Validation
+    void validate(const std::string & filename)
+    {
+        validate(filename, false);
+    }
+
+    void validate(const std::string & filename, const bool verifyChecksums)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (file.is_open() == false)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+
+        StructureScanner scanner(file);
+        scanner.readHeader();
+        scanner.scan(
+            [](const std::string &, const size_t, const uint64_t) {},
+            [&file, verifyChecksums](const PropertyHeader & header)
+            {
+                if (verifyChecksums && header.encoding == 1)
+                {
+                    verifyCompressedArray(file, header);
+                }
+            });
+    }
+
+
+    // Memory resource
+    MemoryResource::~MemoryResource()
+    {
+    }
+
+    MemoryResource * MemoryResource::defaultResource()
+    {
+        static DefaultMemoryResource resource;
+        return &resource;
+    }
+
+
+    // Property traits
+    constexpr bool PropertyTraits<bool>::isPrimitive;
+    constexpr bool PropertyTraits<bool>::isArray;
+    constexpr Property::Type PropertyTraits<bool>::type;
+    constexpr uint8_t PropertyTraits<bool>::code;
+    constexpr Property::Type PropertyTraits<bool>::arrayType;
+    constexpr uint8_t PropertyTraits<bool>::arrayCode;
+
+    constexpr bool PropertyTraits<int16_t>::isPrimitive;
+    constexpr bool PropertyTraits<int16_t>::isArray;
+    constexpr Property::Type PropertyTraits<int16_t>::type;
+    constexpr uint8_t PropertyTraits<int16_t>::code;
+
+    constexpr bool PropertyTraits<int32_t>::isPrimitive;
+    constexpr bool PropertyTraits<int32_t>::isArray;
+    constexpr Property::Type PropertyTraits<int32_t>::type;
+    constexpr uint8_t PropertyTraits<int32_t>::code;
+    constexpr Property::Type PropertyTraits<int32_t>::arrayType;
+    constexpr uint8_t PropertyTraits<int32_t>::arrayCode;
+
+    constexpr bool PropertyTraits<int64_t>::isPrimitive;
+    constexpr bool PropertyTraits<int64_t>::isArray;
+    constexpr Property::Type PropertyTraits<int64_t>::type;
+    constexpr uint8_t PropertyTraits<int64_t>::code;
+    constexpr Property::Type PropertyTraits<int64_t>::arrayType;
+    constexpr uint8_t PropertyTraits<int64_t>::arrayCode;
+
+    constexpr bool PropertyTraits<float>::isPrimitive;
+    constexpr bool PropertyTraits<float>::isArray;
+    constexpr Property::Type PropertyTraits<float>::type;
+    constexpr uint8_t PropertyTraits<float>::code;
+    constexpr Property::Type PropertyTraits<float>::arrayType;
+    constexpr uint8_t PropertyTraits<float>::arrayCode;
+
+    constexpr bool PropertyTraits<double>::isPrimitive;
+    constexpr bool PropertyTraits<double>::isArray;
+    constexpr Property::Type PropertyTraits<double>::type;
+    constexpr uint8_t PropertyTraits<double>::code;
+    constexpr Property::Type PropertyTraits<double>::arrayType;
+    constexpr uint8_t PropertyTraits<double>::arrayCode;
+
+
+    // Property value array
+    Property::ValueArray::ValueArray(const Type type, const uint8_t * data, const uint32_t size) :
+        m_type(type),
+        m_size(size),
+        m_pData(data)
+    {
+    }
+
+    Property::ValueArray::ValueArray(const Type type, const uint8_t * data, const uint32_t size,
+        const std::shared_ptr<const void> & owner) :
+        m_type(type),
+        m_size(size),
+        m_pData(data),
+        m_pOwner(owner)
+    {
+    }
+
+    Property::Type Property::ValueArray::type() const
+    {
+        return m_type;
+    }
+
+    const uint8_t * Property::ValueArray::data() const
+    {
+        return m_pData;
+    }
+
+    uint32_t Property::ValueArray::size() const
+    {
+        return m_size;
+    }
+
+    bool Property::ValueArray::empty() const
+    {
+        return m_size == 0;
+    }
+
+    Property::Value Property::ValueArray::operator [](const size_t index) const
+    {
+        Value value;
+        value.integer64 = 0;
+
+        const size_t size = elementSize(m_type);
+        memcpy(&value, m_pData + index * size, size);
+        return value;
+    }
+
+
+    // Array pager
+    ArrayPager::ArrayPager(const std::string & filename, const size_t budget, MemoryResource * resource) :
+        m_filename(filename),
+        m_budget(budget),
+        m_resident(0),
+        m_pResource(resource),
+        m_pNewest(nullptr),
+        m_pOldest(nullptr)
+    {
+    }
+
+    Property * ArrayPager::createProperty(const Property::Type type, const uint32_t count, const uint64_t offset,
+        const uint32_t storedSize, const uint32_t encoding)
+    {
+        std::unique_ptr<Page> pPage(new Page());
+        ++t_allocations;
+        pPage->pager = shared_from_this();
+        pPage->offset = offset;
+        pPage->storedSize = storedSize;
+        pPage->encoding = encoding;
+        pPage->size = elementSize(type) * count;
+
+        Property * pProperty = new (m_pResource) Property(type, 0, m_pResource);
+        pProperty->m_size = count;
+        pProperty->m_paged = true;
+        pProperty->m_pData = reinterpret_cast<uint8_t *>(pPage.release());
+        return pProperty;
+    }
+
+    size_t ArrayPager::resident() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_resident;
+    }
+
+    // Pins the page for as long as the property holds it, raw pointers have no release point.
+    const uint8_t * ArrayPager::load(const Property & property)
+    {
+        Page * pPage = reinterpret_cast<Page *>(property.m_pData);
+        ArrayPager & pager = *pPage->pager;
+        std::lock_guard<std::mutex> lock(pager.m_mutex);
+        const uint8_t * pData = pager.acquire(pPage);
+        if (pinned(pPage) == false)
+        {
+            pager.unlink(pPage);
+        }
+        pPage->sticky = true;
+        return pData;
+    }
+
+    const uint8_t * ArrayPager::pin(void * page)
+    {
+        Page * pPage = static_cast<Page *>(page);
+        ArrayPager & pager = *pPage->pager;
+        std::lock_guard<std::mutex> lock(pager.m_mutex);
+        const uint8_t * pData = pager.acquire(pPage);
+        if (pinned(pPage) == false)
+        {
+            pager.unlink(pPage);
+        }
+        ++pPage->pins;
+        return pData;
+    }
+
+    void ArrayPager::unpin(void * page)
+    {
+        Page * pPage = static_cast<Page *>(page);
+        std::unique_ptr<Page> pDeleted;
+        ArrayPager & pager = *pPage->pager;
+        std::lock_guard<std::mutex> lock(pager.m_mutex);
+        --pPage->pins;
+        if (pinned(pPage))
+        {
+            return;
+        }
+        if (pPage->released)
+        {
+            pager.m_pResource->deallocate(pPage->pData, pPage->size, alignof(std::max_align_t));
+            pager.m_resident -= pPage->size;
+            pDeleted.reset(pPage);
+            return;
+        }
+        pPage->pOlder = pager.m_pNewest;
+        pPage->pNewer = nullptr;
+        (pager.m_pNewest != nullptr ? pager.m_pNewest->pNewer : pager.m_pOldest) = pPage;
+        pager.m_pNewest = pPage;
+        pager.evict(nullptr);
+    }
+
+    void ArrayPager::copy(const Property & property, uint8_t * output)
+    {
+        Page * pPage = reinterpret_cast<Page *>(property.m_pData);
+        ArrayPager & pager = *pPage->pager;
+        std::lock_guard<std::mutex> lock(pager.m_mutex);
+        memcpy(output, pager.acquire(pPage), pPage->size);
+    }
+
+    void ArrayPager::release(Property & property)
+    {
+        std::unique_ptr<Page> pPage(reinterpret_cast<Page *>(property.m_pData));
+        property.m_pData = nullptr;
+        property.m_paged = false;
+
+        // The page may hold the last reference to the pager, so it is deleted after unlocking.
+        ArrayPager & pager = *pPage->pager;
+        std::lock_guard<std::mutex> lock(pager.m_mutex);
+        if (pPage->pins != 0)
+        {
+            pPage->sticky = false;
+            pPage->released = true;
+            pPage.release();
+            return;
+        }
+        if (pPage->pData != nullptr)
+        {
+            if (pPage->sticky == false)
+            {
+                pager.unlink(pPage.get());
+            }
+            pager.m_pResource->deallocate(pPage->pData, pPage->size, alignof(std::max_align_t));
+            pager.m_resident -= pPage->size;
+        }
+    }
+
+    bool ArrayPager::pinned(const Page * pPage)
+    {
+        return pPage->pins != 0 || pPage->sticky;
+    }
+
+    const uint8_t * ArrayPager::acquire(Page * pPage)
+    {
+        const size_t size = pPage->size;
+        if (pinned(pPage))
+        {
+            return pPage->pData;
+        }
+        if (pPage->pData != nullptr)
+        {
+            unlink(pPage);
+        }
+        else
+        {
+            FBX_TRACE_SCOPE("page-in", std::to_string(size) + " bytes");
+            if (m_file.is_open() == false)
+            {
+                m_file.open(m_filename, std::ios::binary);
+            }
+
+            std::vector<uint8_t> stored(pPage->encoding == 1 ? pPage->storedSize : 0);
+            uint8_t * pData = static_cast<uint8_t *>(m_pResource->allocate(size, alignof(std::max_align_t)));
+            m_file.clear();
+            m_file.seekg(static_cast<std::streamoff>(pPage->offset));
+            m_file.read(reinterpret_cast<char *>(pPage->encoding == 1 ? stored.data() : pData), pPage->storedSize);
+
+            mz_ulong inflatedSize = static_cast<mz_ulong>(size);
+            if (m_file.good() == false || (pPage->encoding == 1 &&
+                (uncompress(pData, &inflatedSize, stored.data(), pPage->storedSize) != MZ_OK || inflatedSize != size)))
+            {
+                m_pResource->deallocate(pData, size, alignof(std::max_align_t));
+                throw std::runtime_error("Failed to load paged array from: " + m_filename);
+            }
+
+            pPage->pData = pData;
+            m_resident += size;
+        }
+
+        // Insert as the most recently used page, then trim the oldest ones down to the budget.
+        pPage->pOlder = m_pNewest;
+        pPage->pNewer = nullptr;
+        (m_pNewest != nullptr ? m_pNewest->pNewer : m_pOldest) = pPage;
+        m_pNewest = pPage;
+        evict(pPage);
+        return pPage->pData;
+    }
+
+    void ArrayPager::unlink(Page * pPage)
+    {
+        (pPage->pNewer != nullptr ? pPage->pNewer->pOlder : m_pNewest) = pPage->pOlder;
+        (pPage->pOlder != nullptr ? pPage->pOlder->pNewer : m_pOldest) = pPage->pNewer;
+        pPage->pNewer = nullptr;
+        pPage->pOlder = nullptr;
+    }
+
+    void ArrayPager::evict(const Page * pKeep)
+    {
+        while (m_resident > m_budget && m_pOldest != nullptr && m_pOldest != pKeep)
+        {
+            Page * pPage = m_pOldest;
+            unlink(pPage);
+            m_pResource->deallocate(pPage->pData, pPage->size, alignof(std::max_align_t));
+            m_resident -= pPage->size;
+            pPage->pData = nullptr;
+        }
+    }
+
+
+    // Property lease
+    Property::Lease::Lease() :
+        m_pProperty(nullptr),
+        m_pData(nullptr),
+        m_pPage(nullptr)
+    {
+    }
+
+    Property::Lease::Lease(const Property & property) :
+        m_pProperty(&property),
+        m_pData(nullptr),
+        m_pPage(property.m_paged && property.m_encoded == false ? property.m_pData : nullptr)
+    {
+        m_pData = m_pPage != nullptr ? ArrayPager::pin(m_pPage) : property.data();
+    }
+
+    Property::Lease::Lease(Lease && lease) :
+        m_pProperty(lease.m_pProperty),
+        m_pData(lease.m_pData),
+        m_pPage(lease.m_pPage)
+    {
+        lease.m_pPage = nullptr;
+    }
+
+    Property::Lease::~Lease()
+    {
+        unpin();
+    }
+
+    Property::Lease & Property::Lease::operator = (Lease && lease)
+    {
+        if (this != &lease)
+        {
+            unpin();
+            m_pProperty = lease.m_pProperty;
+            m_pData = lease.m_pData;
+            m_pPage = lease.m_pPage;
+            lease.m_pPage = nullptr;
+        }
+        return *this;
+    }
+
+    const void * Property::Lease::data() const
+    {
+        return m_pData;
+    }
+
+    Property::ValueArray Property::Lease::array() const
+    {
+        if (m_pProperty == nullptr || m_pProperty->isArray() == false)
+        {
+            return ValueArray(m_pProperty != nullptr ? m_pProperty->m_type : Type::BooleanArray, nullptr, 0);
+        }
+        if (m_pProperty->m_encoded)
+        {
+            throw std::runtime_error("Array property is encoded, decode it before access.");
+        }
+        return ValueArray(m_pProperty->m_type, static_cast<const uint8_t *>(m_pData), m_pProperty->m_size);
+    }
+
+    // Unpins the page itself, as the property may have released it or been destroyed meanwhile.
+    void Property::Lease::unpin()
+    {
+        if (m_pPage != nullptr)
+        {
+            ArrayPager::unpin(m_pPage);
+        }
+        m_pPage = nullptr;
+    }
+
+
+    // Property
+    Property::Property(const bool primitive, MemoryResource * resource) :
+        m_type(Type::Boolean),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.boolean = primitive;
+    }
+
+    Property::Property(const int16_t primitive, MemoryResource * resource) :
+        m_type(Type::Integer16),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.integer16 = primitive;
+    }
+
+    Property::Property(const int32_t primitive, MemoryResource * resource) :
+        m_type(Type::Integer32),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.integer32 = primitive;
+    }
+
+    Property::Property(const int64_t primitive, MemoryResource * resource) :
+        m_type(Type::Integer64),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.integer64 = primitive;
+    }
+
+    Property::Property(const float primitive, MemoryResource * resource) :
+        m_type(Type::Float32),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.float32 = primitive;
+    }
+
+    Property::Property(const double primitive, MemoryResource * resource) :
+        m_type(Type::Float64),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        m_primitive.float64 = primitive;
+    }
+
+    Property::Property(const bool * array, const uint32_t count, MemoryResource * resource) :
+        Property(Type::BooleanArray, count, resource)
+    {
+        if (count)
+        {
+            memcpy(m_pData, array, count * sizeof(bool));
+        }
+    }
+
+    Property::Property(const int32_t * array, const uint32_t count, MemoryResource * resource) :
+        Property(Type::Integer32Array, count, resource)
+    {
+        if (count)
+        {
+            memcpy(m_pData, array, count * sizeof(int32_t));
+        }
+    }
+
+    Property::Property(const int64_t * array, const uint32_t count, MemoryResource * resource) :
+        Property(Type::Integer64Array, count, resource)
+    {
+        if (count)
+        {
+            memcpy(m_pData, array, count * sizeof(int64_t));
+        }
+    }
+
+    Property::Property(const float * array, const uint32_t count, MemoryResource * resource) :
+        Property(Type::Float32Array, count, resource)
+    {
+        if (count)
+        {
+            memcpy(m_pData, array, count * sizeof(float));
+        }
+    }
+
+    Property::Property(const double * array, const uint32_t count, MemoryResource * resource) :
+        Property(Type::Float64Array, count, resource)
+    {
+        if (count)
+        {
+            memcpy(m_pData, array, count * sizeof(double));
+        }
+    }
+
+    Property::Property(const char * p_string, MemoryResource * resource) :
+        Property(reinterpret_cast<const uint8_t *>(p_string), static_cast<uint32_t>(strlen(p_string)), resource)
+    {
+        m_type = Type::String;
+    }
+    Property::Property(const std::string & p_string, MemoryResource * resource) :
+        Property(reinterpret_cast<const uint8_t *>(p_string.c_str()), static_cast<uint32_t>(p_string.size()), resource)
+    {
+        m_type = Type::String;
+    }
+
+    Property::Property(const uint8_t * p_raw, const uint32_t size, MemoryResource * resource) :
+        Property(Type::Raw, size, resource)
+    {
+        if (size)
+        {
+            memcpy(m_pData, p_raw, size);
+        }
+    }
+
+    Property::Property(const Type type, const uint32_t size, MemoryResource * resource) :
+        m_type(type),
+        m_encoded(false),
+        m_paged(false),
+        m_size(0),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        m_primitive.integer64 = 0;
+        if (isPrimitive() == false)
+        {
+            m_size = size;
+            allocate(elementSize(type) * size);
+        }
+    }
+
+    Property::Property(const Type type, const uint32_t size, const uint8_t * encoded, const uint32_t encodedSize, MemoryResource * resource) :
+        m_type(type),
+        m_encoded(true),
+        m_paged(false),
+        m_size(size),
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+    {
+        if (isArray() == false)
+        {
+            throw std::runtime_error("Only array properties can be encoded.");
+        }
+
+        // Encoded payloads are stored behind their compressed size.
+        allocate(encodedSize + 4);
+        memcpy(m_pData, &encodedSize, 4);
+        if (encoded != nullptr && encodedSize)
+        {
+            memcpy(m_pData + 4, encoded, encodedSize);
+        }
+    }
+
+    Property::Property(const Property & property) :
+        m_type(property.m_type),
+        m_encoded(property.m_encoded),
+        m_paged(false),
+        m_size(property.m_size),
+        m_pResource(property.m_pResource)
+    {
+        m_primitive.integer64 = 0;
+        if (isPrimitive())
+        {
+            m_primitive = property.m_primitive;
+            return;
+        }
+        if (property.m_paged)
+        {
+            allocate(elementSize(m_type) * m_size);
+            ArrayPager::copy(property, m_pData);
+            return;
+        }
+
+        const size_t size = property.storageSize();
+        allocate(size);
+        if (size)
+        {
+            memcpy(m_pData, property.m_pData, size);
+        }
+    }
+
+    Property::Property(Property && property) :
+        m_type(property.m_type),
+        m_encoded(property.m_encoded),
+        m_paged(property.m_paged),
+        m_size(property.m_size),
+        m_pResource(property.m_pResource)
+    {
+        m_primitive = property.m_primitive;
+        if (isPrimitive() == false)
+        {
+            property.m_pData = nullptr;
+            property.m_size = 0;
+            property.m_paged = false;
+        }
+    }
+
+    Property::~Property()
+    {
+        release();
+    }
+
+    Property & Property::operator = (const Property & property)
+    {
+        if (this != &property)
+        {
+            Property copy(property);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    Property & Property::operator = (Property && property)
+    {
+        if (this != &property)
+        {
+            release();
+            m_type = property.m_type;
+            m_encoded = property.m_encoded;
+            m_paged = property.m_paged;
+            m_size = property.m_size;
+            m_primitive = property.m_primitive;
+            m_pResource = property.m_pResource;
+            if (isPrimitive() == false)
+            {
+                property.m_pData = nullptr;
+                property.m_size = 0;
+                property.m_paged = false;
+            }
+        }
+        return *this;
+    }
+
+    void * Property::operator new(size_t size)
+    {
+        return allocateObject(size, nullptr);
+    }
+    void * Property::operator new(size_t size, MemoryResource * resource)
+    {
+        return allocateObject(size, resource);
+    }
+
+    void Property::operator delete(void * pointer, size_t size)
+    {
+        deallocateObject(pointer, size);
+    }
+    void Property::operator delete(void * pointer, MemoryResource *)
+    {
+        deallocateObject(pointer, sizeof(Property));
+    }
+
+    Property::Type Property::type() const
+    {
+        return m_type;
+    }
+
+    uint8_t Property::code() const
+    {
+        return typeInfos[static_cast<size_t>(m_type)].code;
+    }
+
+    uint32_t Property::size() const
+    {
+        if (isPrimitive())
+        {
+            return static_cast<uint32_t>(elementSize(m_type));
+        }
+        return m_size;
+    }
+
+    Property::Value & Property::primitive()
+    {
+        return m_primitive;
+    }
+    const Property::Value & Property::primitive() const
+    {
+        return m_primitive;
+    }
+
+    Property::ValueArray Property::array() const
+    {
+        if (isArray() == false)
+        {
+            return ValueArray(m_type, nullptr, 0);
+        }
+        if (m_encoded)
+        {
+            throw std::runtime_error("Array property is encoded, decode it before access.");
+        }
+        std::shared_ptr<const void> lease;
+        const uint8_t * pData = static_cast<const uint8_t *>(leasedData(lease));
+        return ValueArray(m_type, pData, m_size, lease);
+    }
+
+    std::string Property::string() const
+    {
+        return propertyString(m_type, m_primitive, isString() || isRaw() ? m_pData : nullptr, m_size);
+    }
+
+    Span<uint8_t> Property::raw()
+    {
+        if (isString() == false && isRaw() == false)
+        {
+            return Span<uint8_t>();
+        }
+        return Span<uint8_t>(m_pData, m_size);
+    }
+    Span<const uint8_t> Property::raw() const
+    {
+        if (isString() == false && isRaw() == false)
+        {
+            return Span<const uint8_t>();
+        }
+        return Span<const uint8_t>(m_pData, m_size);
+    }
+
+    Span<uint8_t> Property::encoded()
+    {
+        if (m_encoded == false)
+        {
+            return Span<uint8_t>();
+        }
+        return Span<uint8_t>(m_pData + 4, storageSize() - 4);
+    }
+    Span<const uint8_t> Property::encoded() const
+    {
+        if (m_encoded == false)
+        {
+            return Span<const uint8_t>();
+        }
+        return Span<const uint8_t>(m_pData + 4, storageSize() - 4);
+    }
+
+    void Property::decode()
+    {
+        if (m_encoded == false)
+        {
+            return;
+        }
+
+        const Span<const uint8_t> payload = encoded();
+        const size_t size = elementSize(m_type) * m_size;
+        FBX_TRACE_SCOPE("decode", std::to_string(size) + " bytes");
+        uint8_t * pDecoded = size ? static_cast<uint8_t *>(m_pResource->allocate(size, alignof(std::max_align_t))) : nullptr;
+        mz_ulong decodedLength = static_cast<mz_ulong>(size);
+        if (size && (uncompress(pDecoded, &decodedLength, payload.data(), static_cast<mz_ulong>(payload.size())) != MZ_OK || decodedLength != size))
+        {
+            m_pResource->deallocate(pDecoded, size, alignof(std::max_align_t));
+            throw std::runtime_error("Failed to uncompress array property.");
+        }
+
+        release();
+        m_pData = pDecoded;
+        m_encoded = false;
+    }
+
+    uint32_t Property::convert(float * output, const size_t components, float * minimum, float * maximum) const
+    {
+        if (m_type != Type::Float32Array && m_type != Type::Float64Array)
+        {
+            throw std::runtime_error("Only float arrays can be converted.");
+        }
+        if (components == 0 || m_size % components != 0)
+        {
+            throw std::runtime_error("Array length is not a multiple of the component count.");
+        }
+
+        FloatConverter converter(output, components, minimum != nullptr || maximum != nullptr);
+        if (m_encoded == false)
+        {
+            const Lease lease(*this);
+            const uint8_t * pData = static_cast<const uint8_t *>(lease.data());
+            if (m_type == Type::Float64Array)
+            {
+                converter.convert(reinterpret_cast<const double *>(pData), m_size);
+            }
+            else
+            {
+                converter.convert(reinterpret_cast<const float *>(pData), m_size);
+            }
+            converter.bounds(minimum, maximum);
+            return m_size;
+        }
+
+        // Inflate into a small buffer of whole tuples and convert it before inflating the next chunk,
+        // so the decoded array never exists in full.
+        const size_t elementBytes = elementSize(m_type);
+        const size_t chunkElements = std::max<size_t>(1, (16 * 1024 / elementBytes) / components) * components;
+        ArrayInflater inflater(encoded());
+        std::unique_ptr<double[]> pChunk(new double[chunkElements]);
+        size_t remaining = m_size;
+        while (remaining)
+        {
+            const size_t count = std::min(remaining, chunkElements);
+            inflater.read(reinterpret_cast<uint8_t *>(pChunk.get()), count * elementBytes);
+            if (m_type == Type::Float64Array)
+            {
+                converter.convert(pChunk.get(), count);
+            }
+            else
+            {
+                converter.convert(reinterpret_cast<const float *>(pChunk.get()), count);
+            }
+            remaining -= count;
+        }
+        inflater.finish();
+        converter.bounds(minimum, maximum);
+        return m_size;
+    }
+
+    void * Property::data()
+    {
+        if (m_encoded)
+        {
+            return nullptr;
+        }
+        if (m_paged)
+        {
+            // Writable access takes the array out of the pager, as evicting it would drop the changes.
+            const size_t size = elementSize(m_type) * m_size;
+            t_allocations += size ? 1 : 0;
+            uint8_t * pData = static_cast<uint8_t *>(m_pResource->allocate(size, alignof(std::max_align_t)));
+            try
+            {
+                ArrayPager::copy(*this, pData);
+            }
+            catch (...)
+            {
+                m_pResource->deallocate(pData, size, alignof(std::max_align_t));
+                throw;
+            }
+            ArrayPager::release(*this);
+            m_pData = pData;
+        }
+        return isPrimitive() ? static_cast<void *>(&m_primitive) : static_cast<void *>(m_pData);
+    }
+    const void * Property::data() const
+    {
+        if (m_encoded)
+        {
+            return nullptr;
+        }
+        if (m_paged)
+        {
+            return ArrayPager::load(*this);
+        }
+        return isPrimitive() ? static_cast<const void *>(&m_primitive) : static_cast<const void *>(m_pData);
+    }
 
-                memcpy(&data[data.size() - 8], pEncoding, 4);
-                memcpy(&data[data.size() - 4], pCompressedLength, 4);
-                data.insert(data.end(), &(*pBytes)[0], &(*pBytes)[0] + compressedLength);
+    Property::Lease Property::lease() const
+    {
+        return Lease(*this);
+    }
 
-                delete pBytes;
-            }
-        }
+    MemoryResource * Property::resource() const
+    {
+        return m_pResource;
     }
 
+    bool Property::isPrimitive() const
+    {
+        return m_type >= Type::Boolean && m_type <= Type::Float64;
+    }
 
-    // Property
-    Property::Property(const bool primitive) :
-        m_type(Type::Boolean)
+    bool Property::isArray() const
     {
-        m_primitive.boolean = primitive;
+        return m_type >= Type::BooleanArray && m_type <= Type::Float64Array;
     }
 
-    Property::Property(const int16_t primitive) :
-        m_type(Type::Integer16)
+    bool Property::isString() const
     {
-        m_primitive.integer16 = primitive;
+        return m_type == Type::String;
     }
 
-    Property::Property(const int32_t primitive) :
-        m_type(Type::Integer32)
+    bool Property::isRaw() const
     {
-        m_primitive.integer32 = primitive;
+        return m_type == Type::Raw;
     }
 
-    Property::Property(const int64_t primitive) :
-        m_type(Type::Integer64)
+    bool Property::isEncoded() const
     {
-        m_primitive.integer64 = primitive;
+        return m_encoded;
     }
 
-    Property::Property(const float primitive) :
-        m_type(Type::Float32)
+    bool Property::isPaged() const
     {
-        m_primitive.float32 = primitive;
+        return m_paged;
     }
 
-    Property::Property(const double primitive) :
-        m_type(Type::Float64)
+    void Property::allocate(const size_t size)
     {
-        m_primitive.float64 = primitive;
+        t_allocations += size ? 1 : 0;
+        m_pData = size ? static_cast<uint8_t *>(m_pResource->allocate(size, alignof(std::max_align_t))) : nullptr;
     }
 
-    Property::Property(const bool * array, const uint32_t count) :
-        m_type(Type::BooleanArray)
+    void Property::checkType(const Type type) const
     {
-        for (uint32_t i = 0; i < count; ++i)
+        if (m_type != type)
+        {
+            throw std::runtime_error("Property type mismatch, expected '" + std::string(1, static_cast<char>(typeInfos[static_cast<size_t>(type)].code)) +
+                "' but property is '" + std::string(1, static_cast<char>(code())) + "'.");
+        }
+        if (m_encoded)
         {
-            Value value;
-            value.boolean = array[i];
-            m_array.push_back(value);
+            throw std::runtime_error("Array property is encoded, decode it before access.");
         }
     }
 
-    Property::Property(const int32_t * array, const uint32_t count) :
-        m_type(Type::Integer32Array)
+    size_t Property::memoryUsage() const
+    {
+        // Resident paged arrays are bounded by the memory budget rather than counted here.
+        return sizeof(Property) + (m_paged ? sizeof(ArrayPager::Page) : storageSize());
+    }
+
+    size_t Property::storageSize() const
     {
-        for (uint32_t i = 0; i < count; ++i)
+        if (isPrimitive() || m_pData == nullptr)
         {
-            Value value;
-            value.integer32 = array[i];
-            m_array.push_back(value);
+            return 0;
         }
+        if (m_encoded)
+        {
+            uint32_t encodedSize;
+            memcpy(&encodedSize, m_pData, 4);
+            return static_cast<size_t>(encodedSize) + 4;
+        }
+        return elementSize(m_type) * m_size;
     }
 
-    Property::Property(const int64_t * array, const uint32_t count) :
-        m_type(Type::Integer64Array)
+    // Paged arrays are pinned by a shared lease, so views of them stay evictable once dropped.
+    const void * Property::leasedData(std::shared_ptr<const void> & lease) const
     {
-        for (uint32_t i = 0; i < count; ++i)
+        if (m_paged == false || m_encoded)
         {
-            Value value;
-            value.integer64 = array[i];
-            m_array.push_back(value);
+            return data();
         }
+        std::shared_ptr<const Lease> pLease = std::make_shared<Lease>(*this);
+        lease = pLease;
+        return pLease->data();
     }
 
-    Property::Property(float * array, const uint32_t count) :
-        m_type(Type::Float32Array)
+    void Property::release()
     {
-        for (uint32_t i = 0; i < count; ++i)
+        if (m_paged)
+        {
+            ArrayPager::release(*this);
+            return;
+        }
+        if (isPrimitive() == false && m_pData != nullptr)
         {
-            Value value;
-            value.float32 = array[i];
-            m_array.push_back(value);
+            m_pResource->deallocate(m_pData, storageSize(), alignof(std::max_align_t));
+            m_pData = nullptr;
         }
     }
 
-    Property::Property(const double * array, const uint32_t count) :
-        m_type(Type::Float64Array)
+
+    // Property list
+    PropertyList::PropertyList(MemoryResource * resource) :
+        m_properties(resource)
+    {
+
+    }
+
+    PropertyList::~PropertyList()
     {
-        for (uint32_t i = 0; i < count; ++i)
+        for (auto it = m_properties.begin(); it != m_properties.end(); ++it)
         {
-            Value value;
-            value.float64 = array[i];
-            m_array.push_back(value);
+            delete *it;
         }
     }
 
-    Property::Property(const char * p_string) :
-        m_type(Type::String),
-        m_raw(p_string, p_string + strlen(p_string))
+    MemoryResource * PropertyList::resource() const
     {
+        return m_properties.get_allocator().resource();
     }
-    Property::Property(const std::string & p_string) :
-        m_type(Type::String),
-        m_raw(p_string.c_str(), p_string.c_str() + p_string.size())
+
+    size_t PropertyList::size() const
     {
+        return m_properties.size();
     }
 
-    Property::Property(const uint8_t * p_raw, const uint32_t size) :
-        m_type(Type::Raw),
-        m_raw(p_raw, p_raw + size)
+    PropertyList::Iterator PropertyList::insert(Property * p)
     {
+        ++t_allocations;
+        return m_properties.insert(m_properties.end(), p);
     }
-
-    Property::Type Property::type() const
+    PropertyList::Iterator PropertyList::insert(Iterator position, Property * p)
     {
-        return m_type;
+        ++t_allocations;
+        return m_properties.insert(position, p);
     }
 
-    uint8_t Property::code() const
+    PropertyList::Iterator PropertyList::begin()
+    {
+        return m_properties.begin();
+    }
+    PropertyList::ConstIterator PropertyList::begin() const
     {
-        /*'C', 'Y', 'I', 'L', 'F', 'D', 'b', 'i', 'l', 'f', 'd', 'S', 'R'*/
-        return "CYILFDbilfdSR"[static_cast<size_t>(m_type)];
+        return m_properties.begin();
     }
 
-    uint32_t Property::size() const
+    PropertyList::Iterator PropertyList::end()
     {
-        switch (m_type)
-        {
-            case Type::Boolean: return 1;
-            case Type::Integer16: return 2;
-            case Type::Integer32:
-            case Type::Float32: return 4;
-            case Type::Integer64:
-            case Type::Float64: return 8;
-            case Type::BooleanArray: return static_cast<uint32_t>(m_array.size());
-            case Type::Integer32Array:
-            case Type::Float32Array: return static_cast<uint32_t>(m_array.size());
-            case Type::Integer64Array:
-            case Type::Float64Array: return static_cast<uint32_t>(m_array.size());
-            case Type::String:
-            case Type::Raw: return static_cast<uint32_t>(m_raw.size());
-            default: break;
-        }
+        return m_properties.end();
+    }
+    PropertyList::ConstIterator PropertyList::end() const
+    {
+        return m_properties.end();
+    }
 
-        return 0;
+    Property * PropertyList::front()
+    {
+        return m_properties.front();
+    }
+    const Property * PropertyList::front() const
+    {
+        return m_properties.front();
     }
 
-    Property::Value & Property::primitive()
+    Property * PropertyList::back()
     {
-        return m_primitive;
+        return m_properties.back();
     }
-    const Property::Value & Property::primitive() const
+    const Property * PropertyList::back() const
     {
-        return m_primitive;
+        return m_properties.back();
     }
 
-    std::vector<Property::Value> & Property::array()
+    PropertyList::Iterator PropertyList::erase(Property * property)
     {
-        return m_array;
+        for (auto it = m_properties.begin(); it != m_properties.end(); ++it)
+        {
+            if (*it == property)
+            {
+                return erase(it);
+            }
+        }
+        return m_properties.end();
     }
-    const std::vector<Property::Value> & Property::array() const
+    PropertyList::Iterator PropertyList::erase(Iterator position)
     {
-        return m_array;
+        delete *position;
+        return m_properties.erase(position);
     }
 
-    std::string Property::string() const
+    void PropertyList::clear()
     {
-        switch (m_type)
-        {
-            case Type::Boolean: return m_primitive.boolean ? "true" : "false";
-            case Type::Integer16: return std::to_string(m_primitive.integer16);
-            case Type::Integer32: return std::to_string(m_primitive.integer32);
-            case Type::Integer64: return std::to_string(m_primitive.integer64);
-            case Type::Float32: return std::to_string(m_primitive.float32);
-            case Type::Float64: return std::to_string(m_primitive.float64);
-            case Type::BooleanArray: return "array(boolean)";
-            case Type::Integer32Array: return "array(integer32)";
-            case Type::Integer64Array: return "array(integer64)";
-            case Type::Float32Array: return "array(float32)";
-            case Type::Float64Array: return "array(float64)";
-            case Type::String:
-            case Type::Raw: return std::string(m_raw.begin(), m_raw.end());
-            default: break;
+        for (auto it = m_properties.begin(); it != m_properties.end(); ++it)
+        {
+            delete *it;
         }
+        m_properties.clear();
+    }
 
-        return "";
+    PropertyList::PropertyList(PropertyList &)
+    {
     }
 
-    std::vector<uint8_t> & Property::raw()
+
+    // Operation canceled
+    OperationCanceled::OperationCanceled() :
+        std::runtime_error("Operation canceled.")
     {
-        return m_raw;
     }
-    const std::vector<uint8_t> & Property::raw() const
+
+
+    // Statistics
+    Statistics::Statistics() :
+        bytesRead(0),
+        bytesWritten(0),
+        compressedBytes(0),
+        decompressedBytes(0),
+        records(0),
+        properties(0),
+        allocations(0),
+        ioSeconds(0.0),
+        inflateSeconds(0.0),
+        deflateSeconds(0.0),
+        buildSeconds(0.0),
+        serializeSeconds(0.0),
+        totalSeconds(0.0)
     {
-        return m_raw;
     }
 
-    bool Property::isPrimitive() const
+    void Statistics::forEach(const std::function<void(const std::string &, double)> & function) const
     {
-        return m_type >= Type::Boolean && m_type <= Type::Float64;
+        function("bytes_read", static_cast<double>(bytesRead));
+        function("bytes_written", static_cast<double>(bytesWritten));
+        function("compressed_bytes", static_cast<double>(compressedBytes));
+        function("decompressed_bytes", static_cast<double>(decompressedBytes));
+        function("records", static_cast<double>(records));
+        function("properties", static_cast<double>(properties));
+        function("allocations", static_cast<double>(allocations));
+        function("io_seconds", ioSeconds);
+        function("inflate_seconds", inflateSeconds);
+        function("deflate_seconds", deflateSeconds);
+        function("build_seconds", buildSeconds);
+        function("serialize_seconds", serializeSeconds);
+        function("total_seconds", totalSeconds);
     }
 
-    bool Property::isArray() const
+
+    // Tracing
+#if defined(FBX_ENABLE_TRACE)
+    void startTrace()
     {
-        return m_type >= Type::BooleanArray && m_type <= Type::Float64Array;
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+        g_traceEvents.clear();
+        g_traceStart = std::chrono::steady_clock::now();
+        g_tracing = true;
     }
 
-    bool Property::isString() const
+    void stopTrace(const std::string & filename)
     {
-        return m_type == Type::String;
+        std::vector<TraceEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(g_traceMutex);
+            g_tracing = false;
+            events.swap(g_traceEvents);
+        }
+
+        std::ofstream file(filename, std::ios::binary);
+        if (file.is_open() == false)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+
+        file << "{\"traceEvents\":[";
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const TraceEvent & event = events[i];
+            file << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"fbx\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread <<
+                ",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"args\":{\"detail\":\"";
+            for (const unsigned char c : event.detail)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    file << '\\' << c;
+                }
+                else if (c < 0x20 || c >= 0x7F)
+                {
+                    const char digits[] = "0123456789abcdef";
+                    file << "\\u00" << digits[c >> 4] << digits[c & 0xF];
+                }
+                else
+                {
+                    file << c;
+                }
+            }
+            file << "\"}}";
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+#else
+    void startTrace()
+    {
+        throw std::runtime_error("Tracing is not compiled in, define FBX_ENABLE_TRACE.");
+    }
+
+    void stopTrace(const std::string &)
+    {
+        throw std::runtime_error("Tracing is not compiled in, define FBX_ENABLE_TRACE.");
     }
+#endif
+
+
+    // Record serialization and archive streams
+    namespace
+    {
+        struct ZipArchive
+        {
+            ZipArchive() :
+                reading(false),
+                writing(false)
+            {
+                memset(&archive, 0, sizeof(archive));
+            }
+
+            ~ZipArchive()
+            {
+                if (writing)
+                {
+                    mz_zip_writer_end(&archive);
+                }
+                else if (reading)
+                {
+                    mz_zip_reader_end(&archive);
+                }
+            }
+
+            mz_zip_archive  archive;
+            bool            reading;
+            bool            writing;
+        };
+
+        // Read-only stream buffer inflating a zip entry on demand. Seeks are lazy: they only move the
+        // logical position, and the next read skips forward or restarts the entry if it moved backwards.
+        class ZipEntryBuffer : public std::streambuf
+        {
+
+        public:
+
+            ZipEntryBuffer(mz_zip_archive * archive, const mz_uint index, const uint64_t size) :
+                m_pArchive(archive),
+                m_index(index),
+                m_size(size),
+                m_pState(nullptr),
+                m_produced(0),
+                m_bufferStart(0),
+                m_buffer(64 * 1024)
+            {
+                setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+            }
+
+            ~ZipEntryBuffer()
+            {
+                if (m_pState != nullptr)
+                {
+                    mz_zip_reader_extract_iter_free(m_pState);
+                }
+            }
+
+            // Inflates whatever the reader skipped, as miniz only checks the entry CRC once all of it is extracted.
+            void verify()
+            {
+                if (m_pState == nullptr)
+                {
+                    restart();
+                }
+                while (m_produced < m_size)
+                {
+                    pull(static_cast<size_t>(std::min<uint64_t>(m_size - m_produced, m_buffer.size())));
+                }
+                setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+                m_bufferStart = m_size;
+
+                const bool valid = mz_zip_reader_extract_iter_free(m_pState) != MZ_FALSE;
+                m_pState = nullptr;
+                if (valid == false)
+                {
+                    throw std::runtime_error("Archive entry checksum mismatch.");
+                }
+            }
+
+        protected:
+
+            int_type underflow() override
+            {
+                const uint64_t position = m_bufferStart + static_cast<uint64_t>(gptr() - eback());
+                if (position >= m_size)
+                {
+                    return traits_type::eof();
+                }
+                if (m_pState == nullptr || position < m_produced)
+                {
+                    restart();
+                }
+
+                // Discard everything up to the requested position, then fill the buffer from there.
+                while (m_produced < position)
+                {
+                    pull(static_cast<size_t>(std::min<uint64_t>(position - m_produced, m_buffer.size())));
+                }
+
+                const size_t count = pull(static_cast<size_t>(std::min<uint64_t>(m_size - position, m_buffer.size())));
+                m_bufferStart = position;
+                setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + count);
+                return traits_type::to_int_type(*gptr());
+            }
+
+            pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override
+            {
+                int64_t base = 0;
+                if (direction == std::ios_base::cur)
+                {
+                    base = static_cast<int64_t>(m_bufferStart) + (gptr() - eback());
+                }
+                else if (direction == std::ios_base::end)
+                {
+                    base = static_cast<int64_t>(m_size);
+                }
+                return seekpos(pos_type(static_cast<off_type>(base + offset)), std::ios_base::in);
+            }
+
+            pos_type seekpos(pos_type position, std::ios_base::openmode) override
+            {
+                const int64_t target = static_cast<int64_t>(position);
+                if (target < 0 || static_cast<uint64_t>(target) > m_size)
+                {
+                    return pos_type(off_type(-1));
+                }
+
+                const uint64_t offset = static_cast<uint64_t>(target);
+                if (offset >= m_bufferStart && offset <= m_bufferStart + static_cast<uint64_t>(egptr() - eback()))
+                {
+                    setg(eback(), eback() + (offset - m_bufferStart), egptr());
+                }
+                else
+                {
+                    // Keep the buffer contents as they are; underflow decides whether they can be reused.
+                    m_bufferStart = offset;
+                    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+                }
+                return position;
+            }
+
+        private:
+
+            void restart()
+            {
+                if (m_pState != nullptr)
+                {
+                    mz_zip_reader_extract_iter_free(m_pState);
+                }
+                m_pState = mz_zip_reader_extract_iter_new(m_pArchive, m_index, 0);
+                if (m_pState == nullptr)
+                {
+                    throw std::runtime_error("Failed to open archive entry.");
+                }
+                m_produced = 0;
+            }
+
+            size_t pull(const size_t size)
+            {
+                const size_t count = mz_zip_reader_extract_iter_read(m_pState, m_buffer.data(), size);
+                if (count != size)
+                {
+                    throw std::runtime_error("Failed to inflate archive entry.");
+                }
+                m_produced += count;
+                return count;
+            }
+
+            mz_zip_archive *                    m_pArchive;
+            mz_uint                             m_index;
+            uint64_t                            m_size;
+            mz_zip_reader_extract_iter_state *  m_pState;
+            uint64_t                            m_produced;
+            uint64_t                            m_bufferStart;
+            std::vector<char>                   m_buffer;
+
+        };
+
+        // Bytes of a record and its properties when stored uncompressed, excluding its children.
+        uint64_t serializedSize(const Record & record)
+        {
+            uint64_t size = 13 + record.name().size() + (record.size() ? 13 : 0);
+            for (const Property * pProperty : record.properties())
+            {
+                size += 1;
+                if (pProperty->isPrimitive())
+                {
+                    size += pProperty->size();
+                }
+                else if (pProperty->isEncoded())
+                {
+                    size += 12 + pProperty->encoded().size();
+                }
+                else if (pProperty->isArray())
+                {
+                    size += 12 + static_cast<uint64_t>(pProperty->size()) * elementSize(pProperty->type());
+                }
+                else
+                {
+                    size += 4 + pProperty->raw().size();
+                }
+            }
+            return size;
+        }
+
+        uint64_t serializedTreeSize(const Record & record)
+        {
+            uint64_t size = 27 + 13;
+            std::vector<const Record *> pending(record.begin(), record.end());
+            while (pending.size())
+            {
+                const Record * pRecord = pending.back();
+                pending.pop_back();
+                size += serializedSize(*pRecord);
+                pending.insert(pending.end(), pRecord->begin(), pRecord->end());
+            }
+            return size;
+        }
+
+        void serialize(const Record & record, const uint32_t version, std::vector<uint8_t> & data, Statistics * pStatistics, ProgressReporter & progress)
+        {
+            FBX_TRACE_SCOPE("serialize", "");
+            uint64_t processed = 27;
+
+            // Write FBX header.
+            const uint8_t magic[21] = "Kaydara FBX Binary  ";
+            const uint8_t * pVersion = reinterpret_cast<const uint8_t*>(&version);
+
+            data.insert(data.end(), magic, magic + 21);
+            data.push_back(0x1A);
+            data.push_back(0);
+            data.insert(data.end(), pVersion, pVersion + 4);
+
+            std::stack<std::tuple<Record::ConstIterator, Record::ConstIterator, uint32_t>> stack;
+            if (record.size())
+            {
+                stack.push(std::make_tuple(record.begin(), record.end(), 0));
+            }
+
+            while (stack.size())
+            {
+                auto & top = stack.top();
+                Record::ConstIterator & currentIt = std::get<0>(top);
+                Record::ConstIterator & endIt = std::get<1>(top);
+                uint32_t & parentStart = std::get<2>(top);
+
+                if (parentStart != 0)
+                {
+                    const uint32_t currentPos = static_cast<uint32_t>(data.size());
+                    const uint8_t * pCurrentPos = reinterpret_cast<const uint8_t *>(&currentPos);
+                    data[parentStart] = pCurrentPos[0];
+                    data[parentStart + 1] = pCurrentPos[1];
+                    data[parentStart + 2] = pCurrentPos[2];
+                    data[parentStart + 3] = pCurrentPos[3];
+                }
+
+                if (currentIt == endIt)
+                {
+                    data.insert(data.end(), 13, 0);
+                    stack.pop();
+
+                    continue;
+                }
 
-    bool Property::isRaw() const
-    {
-        return m_type == Type::Raw;
-    }
+                const Record * pRecord = *currentIt;
+                parentStart = static_cast<uint32_t>(data.size());
+                ++currentIt;
 
+                if (pStatistics != nullptr)
+                {
+                    ++pStatistics->records;
+                    pStatistics->properties += pRecord->properties().size();
+                }
+                if (progress.enabled())
+                {
+                    processed += serializedSize(*pRecord);
+                    progress.update(processed);
+                }
 
-    // Property list
-    PropertyList::PropertyList()
-    {
+                // Write record header.
+                const auto & properties = pRecord->properties();
+                const uint32_t numProperties = static_cast<uint32_t>(properties.size());
+                const uint8_t * pNumProperties = reinterpret_cast<const uint8_t*>(&numProperties);
+                const String & name = pRecord->name();
+                const uint8_t * pName = reinterpret_cast<const uint8_t*>(&name[0]);
+                const uint8_t nameLength = static_cast<uint8_t>(name.size());
+                data.insert(data.end(), 4, 0);
+                data.insert(data.end(), pNumProperties, pNumProperties + 4);
+                const uint32_t propertiesOffset = static_cast<uint32_t>(data.size());
+                data.insert(data.end(), 4, 0);
+                data.push_back(nameLength);
+                data.insert(data.end(), pName, pName + nameLength);
+
+                // Write record properties.
+                const uint32_t propertyStart = static_cast<uint32_t>(data.size());
+                for (auto pIt = properties.begin(); pIt != properties.end(); ++pIt)
+                {
+                    Property * pProperty = *pIt;
+                    data.push_back(pProperty->code());
 
-    }
+                    if (pProperty->isPrimitive())
+                    {
+                        writePrimitive(data, *pProperty);
+                    }
+                    else if (pProperty->isEncoded())
+                    {
+                        writeEncodedArray(data, *pProperty, pStatistics);
+                    }
+                    else if (pProperty->isArray())
+                    {
+                        writeArray(data, pProperty->lease().array(), pStatistics);
+                    }
+                    else
+                    {
+                        writeRaw(data, pProperty->raw());
+                    }
+                }
 
-    PropertyList::~PropertyList()
-    {
-        for (auto it = m_properties.begin(); it != m_properties.end(); ++it)
-        {
-            delete *it;
+                // Set properties length
+                const uint32_t propertiesEnd = static_cast<uint32_t>(data.size());
+                const uint32_t propertiesLength = propertiesEnd - propertyStart;
+                const uint8_t * pPropertiesLength = reinterpret_cast<const uint8_t*>(&propertiesLength);
+                data[propertiesOffset] = pPropertiesLength[0];
+                data[propertiesOffset + 1] = pPropertiesLength[1];
+                data[propertiesOffset + 2] = pPropertiesLength[2];
+                data[propertiesOffset + 3] = pPropertiesLength[3];
+
+                // Add nested list.
+                if (pRecord->size())
+                {
+                    stack.push(std::make_tuple(pRecord->begin(), pRecord->end(), 0));
+                }
+            }
         }
     }
 
-    size_t PropertyList::size() const
-    {
-        return m_properties.size();
-    }
 
-    PropertyList::Iterator PropertyList::insert(Property * p)
-    {
-        return m_properties.insert(m_properties.end(), p);
-    }
-    PropertyList::Iterator PropertyList::insert(Iterator position, Property * p)
+    // Record class.
+    Record::Record() :
+        Record(static_cast<MemoryResource *>(nullptr))
     {
-        return m_properties.insert(position, p);
     }
 
-    PropertyList::Iterator PropertyList::begin()
+    Record::Record(MemoryResource * resource) :
+        m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource()),
+        m_name(m_pResource),
+        m_pParent(nullptr),
+        m_pFirstChild(nullptr),
+        m_pLastChild(nullptr),
+        m_pPrevSibling(nullptr),
+        m_pNextSibling(nullptr),
+        m_size(0),
+        m_properties(m_pResource),
+        m_memoryUsage(0)
     {
-        return m_properties.begin();
     }
-    PropertyList::ConstIterator PropertyList::begin() const
+
+    Record::Record(const std::string & p_name) :
+        Record()
     {
-        return m_properties.begin();
+        name(p_name);
     }
 
-    PropertyList::Iterator PropertyList::end()
+    Record::Record(const std::string & p_name, Record * parent) :
+        Record(parent != nullptr ? parent->resource() : nullptr)
     {
-        return m_properties.end();
+        name(p_name);
+        if (parent != nullptr)
+        {
+            parent->insert(this);
+        }
     }
-    PropertyList::ConstIterator PropertyList::end() const
+
+    Record::~Record()
     {
-        return m_properties.end();
+        clear();
+        detach();
     }
 
-    Property * PropertyList::front()
+    void * Record::operator new(size_t size)
     {
-        return m_properties.front();
+        return allocateObject(size, nullptr);
     }
-    const Property * PropertyList::front() const
+    void * Record::operator new(size_t size, MemoryResource * resource)
     {
-        return m_properties.front();
+        return allocateObject(size, resource);
     }
 
-    Property * PropertyList::back()
+    void Record::operator delete(void * pointer, size_t size)
     {
-        return m_properties.back();
+        deallocateObject(pointer, size);
     }
-    const Property * PropertyList::back() const
+    void Record::operator delete(void * pointer, MemoryResource *)
     {
-        return m_properties.back();
+        deallocateObject(pointer, sizeof(Record));
     }
 
-    PropertyList::Iterator PropertyList::erase(Property * property)
+    void Record::read(const std::string & filename)
     {
-        return m_properties.end();
+        read(filename, ReadOptions());
     }
-    PropertyList::Iterator PropertyList::erase(Iterator position)
+
+    void Record::read(const std::string & filename, std::function<void(std::string, uint32_t)> onHeaderRead)
     {
-        return m_properties.end();
+        ReadOptions options;
+        options.onHeaderRead = onHeaderRead;
+        read(filename, options);
     }
 
-    void PropertyList::clear()
+    void Record::read(const std::string & filename, const ReadOptions & options)
     {
-        for (auto it = m_properties.begin(); it != m_properties.end(); ++it)
+        std::ifstream file(filename, std::ios::binary);
+        if (file.is_open() == false)
         {
-            delete *it;
+            throw std::runtime_error("Failed to open file.");
         }
-        m_properties.clear();
-    }
-
-    PropertyList::PropertyList(PropertyList & pl)
-    {
-    }
-
 
-    // Record class.
-    Record::Record() :
-        m_name(""),
-        m_pParent(nullptr)
-    {
+        std::shared_ptr<ArrayPager> pager;
+        if (options.memoryBudget != 0)
+        {
+            pager = std::make_shared<ArrayPager>(filename, options.memoryBudget, m_pResource);
+        }
+        read(file, options, pager.get());
     }
 
-    Record::Record(const std::string & p_name) :
-        Record()
+    void Record::readZip(const std::string & archive, const std::string & entry)
     {
-        name(p_name);
+        readZip(archive, entry, ReadOptions());
     }
 
-    Record::Record(const std::string & name, Record * parent) :
-        Record(name)
+    void Record::readZip(const std::string & archive, const std::string & entry, const ReadOptions & options)
     {
-        if (parent != nullptr)
+        ZipArchive zip;
+        if (mz_zip_reader_init_file(&zip.archive, archive.c_str(), 0) == false)
         {
-            parent->insert(this);
+            throw std::runtime_error("Failed to open archive.");
         }
-    }
+        zip.reading = true;
 
-    Record::~Record()
-    {
-        for (auto it = m_nestedList.begin(); it != m_nestedList.end(); ++it)
+        const int index = mz_zip_reader_locate_file(&zip.archive, entry.c_str(), nullptr, 0);
+        mz_zip_archive_file_stat stat;
+        if (index < 0 || mz_zip_reader_file_stat(&zip.archive, static_cast<mz_uint>(index), &stat) == false)
         {
-            delete *it;
+            throw std::runtime_error("Archive entry not found.");
         }
-    }
 
-    void Record::read(const std::string & filename)
-    {
-        read(filename, [](std::string, uint32_t) {});
+        // Inflate errors are thrown by the buffer, rethrown by the stream instead of only setting badbit.
+        AppendedRecordsGuard appendedRecords(*this);
+        ZipEntryBuffer buffer(&zip.archive, static_cast<mz_uint>(index), stat.m_uncomp_size);
+        std::istream stream(&buffer);
+        stream.exceptions(std::ios::badbit);
+        read(stream, options);
+        buffer.verify();
+        appendedRecords.dismiss();
     }
 
-    void Record::read(const std::string & filename, std::function<void(std::string, uint32_t)> onHeaderRead)
+    void Record::read(std::istream & file, const ReadOptions & options)
     {
-        std::ifstream file(filename, std::ios::binary);
-        if (file.is_open() == false)
+        if (options.memoryBudget != 0)
         {
-            throw std::runtime_error("Failed to open file.");
+            throw std::runtime_error("Memory budgeted reads require a file name.");
         }
+        read(file, options, nullptr);
+    }
+
+    void Record::read(std::istream & file, const ReadOptions & options, ArrayPager * pager)
+    {
+        FBX_TRACE_SCOPE("read", "");
+        StatisticsCollector collector(options);
+        Statistics * pStatistics = collector.statistics();
+        SubtreeTracer subtrees;
 
         // Get file size.
         file.seekg(0, std::ios::end);
         std::streampos streamPos = file.tellg();
+        if (file.fail() || streamPos < 0)
+        {
+            throw std::runtime_error("Failed to read input size.");
+        }
         if (streamPos > static_cast<std::streampos>(std::numeric_limits<uint32_t>::max()))
         {
             throw std::runtime_error("Input file size is too big.");
         }
         const std::size_t fileSize = static_cast<std::size_t>(streamPos);
         file.seekg(0, std::ios::beg);
+        ProgressReporter progress(options, fileSize);
+        AppendedRecordsGuard appendedRecords(*this);
 
         // Read header.
         std::string magic(20, '\0');
@@ -604,9 +5834,12 @@ namespace Fbx
         file.read(reinterpret_cast<char*>(&version), 4);
 
         // call on header function.
-        onHeaderRead(magic, version);
+        if (options.onHeaderRead)
+        {
+            options.onHeaderRead(magic, version);
+        }
 
-        if (file.eof())
+        if (file.fail())
         {
             throw std::runtime_error("Invalid FBX file.");
         }
@@ -622,22 +5855,26 @@ namespace Fbx
             uint32_t propertyListLen = 0;
             uint8_t nameLen = 0;
             const size_t recordPos = static_cast<size_t>(file.tellg());
+            std::string name;
+            {
+                ScopedTimer ioTimer(timer(pStatistics, &Statistics::ioSeconds));
+                file.read(reinterpret_cast<char*>(&endOffset), 4);
+                file.read(reinterpret_cast<char*>(&numProperties), 4);
+                file.read(reinterpret_cast<char*>(&propertyListLen), 4);
+                file.read(reinterpret_cast<char*>(&nameLen), 1);
+
+                name.resize(nameLen);
+                file.read(&name[0], nameLen);
+            }
 
-            file.read(reinterpret_cast<char*>(&endOffset), 4);
-            file.read(reinterpret_cast<char*>(&numProperties), 4);
-            file.read(reinterpret_cast<char*>(&propertyListLen), 4);
-            file.read(reinterpret_cast<char*>(&nameLen), 1);
-
-            std::string name(nameLen, '\0');
-            file.read(&name[0], nameLen);
-
-            if (file.eof())
+            if (file.fail())
             {
                 throw std::runtime_error("Invalid record header.");
             }
 
             if (endOffset == 0) // End of nested list.
             {
+                subtrees.close(recordStack.top().first);
                 recordStack.pop();
                 continue;
             }
@@ -663,177 +5900,321 @@ namespace Fbx
             }
 
             // Create and add new record.
-            Record * pNewRecord = new Record(name, pParentRecord);
+            Record * pNewRecord = new (m_pResource) Record(name, pParentRecord);
             recordStack.push(std::make_pair(pNewRecord, endOffset));
+            subtrees.open();
+            if (pStatistics != nullptr)
+            {
+                ++pStatistics->records;
+            }
 
             // Read properties.
             size_t propertiesByteRead = 0;
-            PropertyReader reader(file, pNewRecord);
+            PropertyReader reader(file, pNewRecord, options.deferArrays, pager, pStatistics);
 
             for (uint32_t i = 0; i < numProperties; ++i)
             {
                 uint8_t code;
-                file.read(reinterpret_cast<char*>(&code), 1);
-
-                if (code == 'S' || code == 'R') // String/raw.
-                {
-                    propertiesByteRead += reader.readRaw(code) + 1;
-                }
-                else if (code < 'Z') // primitives.
-                {
-                    propertiesByteRead += reader.readPrimitive(code) + 1;
-                }
-                else // arrays.
                 {
-                    propertiesByteRead += reader.readArray(code) + 1;
+                    ScopedTimer ioTimer(timer(pStatistics, &Statistics::ioSeconds));
+                    file.read(reinterpret_cast<char*>(&code), 1);
                 }
+
+                propertiesByteRead += reader.read(code) + 1;
+            }
+            if (file.fail())
+            {
+                throw std::runtime_error(std::string("Failed to read properties of record: ") + name);
             }
 
             // Make sure all property bytes are extracted.
             if (propertiesByteRead != propertyListLen)
             {
-                throw std::runtime_error("Invalid property list length of record: " + pParentRecord->name());
+                throw std::runtime_error(std::string("Invalid property list length of record: ") + pParentRecord->name().c_str());
             }
 
             // Error check end record of nested list.
             const size_t curFilePos = static_cast<size_t>(file.tellg());
             if (parentEndOffset <= curFilePos)
             {
-                throw std::runtime_error("Missing nested list end of record: " + pParentRecord->name());
+                throw std::runtime_error(std::string("Missing nested list end of record: ") + pParentRecord->name().c_str());
             }
+            progress.update(curFilePos);
 
             // Exit record if no nested list is present.
             if (endOffset == curFilePos)
             {
+                subtrees.close(pNewRecord);
                 recordStack.pop();
                 continue;
             }
 
             // Read nested list next loop.
         }
+
+        if (pStatistics != nullptr)
+        {
+            pStatistics->bytesRead = static_cast<uint64_t>(file.tellg());
+        }
+        progress.finish();
+        appendedRecords.dismiss();
+        collector.finish(&Statistics::buildSeconds);
     }
 
     void Record::write(const std::string & filename) const
     {
-        write(filename, 7100);
+        write(filename, WriteOptions());
     }
 
     void Record::write(const std::string & filename, const uint32_t version) const
     {
+        WriteOptions options;
+        options.version = version;
+        write(filename, options);
+    }
+
+    void Record::write(const std::string & filename, const WriteOptions & options) const
+    {
+        FBX_TRACE_SCOPE("write", filename);
+        StatisticsCollector collector(options);
+        Statistics * pStatistics = collector.statistics();
+
+        ProgressReporter progress(options, options.onProgress ? serializedTreeSize(*this) : 0);
+
+        // Serialize before opening the file, leaving it untouched if canceled.
+        std::vector<uint8_t> data;
+        serialize(*this, options.version, data, pStatistics, progress);
+        progress.finish();
+
         std::ofstream file(filename, std::ios::binary);
         if (file.is_open() == false)
         {
             throw std::runtime_error("Failed to open file.");
         }
+        {
+            ScopedTimer ioTimer(timer(pStatistics, &Statistics::ioSeconds));
+            file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+            file.flush();
+        }
+
+        if (pStatistics != nullptr)
+        {
+            pStatistics->bytesWritten = data.size();
+        }
+        collector.finish(&Statistics::serializeSeconds);
+    }
+
+    void Record::writeZip(const std::string & archive, const std::string & entry) const
+    {
+        writeZip(archive, entry, WriteOptions());
+    }
+
+    void Record::writeZip(const std::string & archive, const std::string & entry, const uint32_t version) const
+    {
+        WriteOptions options;
+        options.version = version;
+        writeZip(archive, entry, options);
+    }
 
+    void Record::writeZip(const std::string & archive, const std::string & entry, const WriteOptions & options) const
+    {
+        FBX_TRACE_SCOPE("writeZip", archive + "/" + entry);
+        StatisticsCollector collector(options);
+        Statistics * pStatistics = collector.statistics();
+
+        ProgressReporter progress(options, options.onProgress ? serializedTreeSize(*this) : 0);
         std::vector<uint8_t> data;
+        serialize(*this, options.version, data, pStatistics, progress);
+        progress.finish();
 
-        // Write FBX header.
-        const uint8_t magic[21] = "Kaydara FBX Binary  ";
-        const uint8_t * pVersion = reinterpret_cast<const uint8_t*>(&version);
+        // Append to an existing archive in place, or create a new one.
+        ZipArchive zip;
+        if (mz_zip_reader_init_file(&zip.archive, archive.c_str(), 0))
+        {
+            zip.reading = true;
+            if (mz_zip_reader_locate_file(&zip.archive, entry.c_str(), nullptr, 0) >= 0)
+            {
+                throw std::runtime_error("Archive entry already exists.");
+            }
+            if (mz_zip_writer_init_from_reader(&zip.archive, archive.c_str()) == false)
+            {
+                throw std::runtime_error("Failed to open archive for writing.");
+            }
+        }
+        else
+        {
+            zip = ZipArchive();
+            if (mz_zip_writer_init_file(&zip.archive, archive.c_str(), 0) == false)
+            {
+                throw std::runtime_error("Failed to create archive.");
+            }
+        }
+        zip.reading = false;
+        zip.writing = true;
 
-        data.insert(data.end(), magic, magic + 21);
-        data.push_back(0x1A);
-        data.push_back(0);
-        data.insert(data.end(), pVersion, pVersion + 4);
+        {
+            ScopedTimer ioTimer(timer(pStatistics, &Statistics::ioSeconds));
+            if (mz_zip_writer_add_mem(&zip.archive, entry.c_str(), data.data(), data.size(), MZ_DEFAULT_COMPRESSION) == false ||
+                mz_zip_writer_finalize_archive(&zip.archive) == false)
+            {
+                throw std::runtime_error("Failed to write archive entry.");
+            }
+        }
 
-        std::stack<std::tuple<ConstIterator, ConstIterator, uint32_t>> stack;
-        if (m_nestedList.size())
+        if (pStatistics != nullptr)
         {
-            stack.push(std::make_tuple(m_nestedList.begin(), m_nestedList.end(), 0));
+            pStatistics->bytesWritten = data.size();
         }
+        collector.finish(&Statistics::serializeSeconds);
+    }
 
-        while (stack.size())
+    void Record::writeSnapshot(const std::string & filename) const
+    {
+        // Lay out the node and property tables breadth first, interning the names.
+        std::vector<const Record *> records(1, this);
+        std::vector<SnapshotNode> nodes;
+        std::vector<SnapshotProperty> properties;
+        std::vector<const Property *> sources;
+        std::vector<const String *> names;
+        std::unordered_map<std::string, uint32_t> nameIndices;
+
+        for (size_t i = 0; i < records.size(); i++)
         {
-            auto & top = stack.top();
-            ConstIterator & currentIt = std::get<0>(top);
-            ConstIterator & endIt = std::get<1>(top);
-            uint32_t & parentStart = std::get<2>(top);
+            const Record * pRecord = records[i];
+            if (records.size() + pRecord->size() > snapshotNoParent || properties.size() + pRecord->properties().size() > snapshotNoParent)
+            {
+                throw std::runtime_error("Record tree too large for a snapshot.");
+            }
 
-            if (parentStart != 0)
+            const std::string name(pRecord->m_name.c_str(), pRecord->m_name.size());
+            auto nameIt = nameIndices.find(name);
+            if (nameIt == nameIndices.end())
             {
-                const uint32_t currentPos = static_cast<uint32_t>(data.size());
-                const uint8_t * pCurrentPos = reinterpret_cast<const uint8_t *>(&currentPos);
-                data[parentStart] = pCurrentPos[0];
-                data[parentStart + 1] = pCurrentPos[1];
-                data[parentStart + 2] = pCurrentPos[2];
-                data[parentStart + 3] = pCurrentPos[3];
+                nameIt = nameIndices.insert(std::make_pair(name, static_cast<uint32_t>(names.size()))).first;
+                names.push_back(&pRecord->m_name);
             }
 
-            if (currentIt == endIt)
+            SnapshotNode node;
+            node.name = nameIt->second;
+            node.parent = snapshotNoParent;
+            node.firstChild = static_cast<uint32_t>(records.size());
+            node.childCount = static_cast<uint32_t>(pRecord->size());
+            node.firstProperty = static_cast<uint32_t>(properties.size());
+            node.propertyCount = static_cast<uint32_t>(pRecord->properties().size());
+            nodes.push_back(node);
+
+            records.insert(records.end(), pRecord->begin(), pRecord->end());
+            for (const Property * pProperty : pRecord->properties())
             {
-                data.insert(data.end(), 13, 0);
-                stack.pop();
+                SnapshotProperty property;
+                memset(&property, 0, sizeof(property));
+                property.type = static_cast<uint8_t>(pProperty->type());
+                property.size = pProperty->isPrimitive() ? 0 : pProperty->size();
+                if (pProperty->isPrimitive())
+                {
+                    memcpy(&property.value, pProperty->data(), pProperty->size());
+                }
+                properties.push_back(property);
+                sources.push_back(pProperty);
+            }
+        }
 
-                continue;
+        // Children were appended in order, so each node is the parent of its child range.
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            for (uint32_t child = nodes[i].firstChild; child < nodes[i].firstChild + nodes[i].childCount; child++)
+            {
+                nodes[child].parent = i;
             }
+        }
 
-            const Record * pRecord = *currentIt;
-            parentStart = static_cast<uint32_t>(data.size());
-            ++currentIt;
-
-            // Write record header.
-            const auto & properties = pRecord->properties();
-            const uint32_t numProperties = static_cast<uint32_t>(properties.size());
-            const uint8_t * pNumProperties = reinterpret_cast<const uint8_t*>(&numProperties);
-            const std::string & name = pRecord->name();
-            const uint8_t * pName = reinterpret_cast<const uint8_t*>(&name[0]);
-            const uint8_t nameLength = static_cast<uint8_t>(name.size());
-            data.insert(data.end(), 4, 0);
-            data.insert(data.end(), pNumProperties, pNumProperties + 4);
-            const uint32_t propertiesOffset = static_cast<uint32_t>(data.size());
-            data.insert(data.end(), 4, 0);
-            data.push_back(nameLength);
-            data.insert(data.end(), pName, pName + nameLength);
-
-            // Write record properties.
-            const uint32_t propertyStart = static_cast<uint32_t>(data.size());
-            for (auto pIt = properties.begin(); pIt != properties.end(); ++pIt)
-            {
-                Property * pProperty = *pIt;
-                data.push_back(pProperty->code());
-
-                switch (pProperty->code())
-                {
-                case 'I': writePrimitive(data, pProperty->primitive().integer32); break;
-                case 'L': writePrimitive(data, pProperty->primitive().integer64); break;
-                case 'F': writePrimitive(data, pProperty->primitive().float32); break;
-                case 'D': writePrimitive(data, pProperty->primitive().float64); break;
-                case 'C': writePrimitive(data, pProperty->primitive().boolean); break;
-                case 'Y': writePrimitive(data, pProperty->primitive().integer16); break;
-                case 'i': writeArray<int32_t>(data, pProperty->array()); break;
-                case 'l': writeArray<int64_t>(data, pProperty->array()); break;
-                case 'f': writeArray<float>(data, pProperty->array()); break;
-                case 'd': writeArray<double>(data, pProperty->array()); break;
-                case 'b': writeArray<bool>(data, pProperty->array()); break;
-                case 'R':
-                case 'S': writeRaw(data, pProperty->raw()); break;
-                default: break;
-                }
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+        header.version = snapshotVersion;
+        header.nodeCount = static_cast<uint32_t>(nodes.size());
+        header.propertyCount = static_cast<uint32_t>(properties.size());
+        header.nameCount = static_cast<uint32_t>(names.size());
+        header.nodes = alignSnapshot(sizeof(SnapshotHeader));
+        header.properties = alignSnapshot(header.nodes + nodes.size() * sizeof(SnapshotNode));
+        header.names = alignSnapshot(header.properties + properties.size() * sizeof(SnapshotProperty));
+
+        std::vector<SnapshotName> nameTable(names.size());
+        uint64_t offset = header.names + names.size() * sizeof(SnapshotName);
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            nameTable[i].offset = offset;
+            nameTable[i].length = static_cast<uint32_t>(names[i]->size());
+            nameTable[i].reserved = 0;
+            offset += names[i]->size() + 1;
+        }
+        for (size_t i = 0; i < properties.size(); i++)
+        {
+            if (sources[i]->isPrimitive() == false)
+            {
+                offset = alignSnapshot(offset);
+                properties[i].value = offset;
+                offset += static_cast<uint64_t>(properties[i].size) * elementSize(sources[i]->type());
             }
+        }
+        header.size = offset;
+
+        std::ofstream file(filename, std::ios::binary);
+        if (file.is_open() == false)
+        {
+            throw std::runtime_error("Failed to open file.");
+        }
+
+        uint64_t position = 0;
+        const char zeros[snapshotAlignment] = {};
+        auto write = [&](const void * data, const uint64_t size, const uint64_t at)
+        {
+            file.write(zeros, static_cast<std::streamsize>(at - position));
+            file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            position = at + size;
+        };
 
-            // Set properties length
-            const uint32_t propertiesEnd = static_cast<uint32_t>(data.size());
-            const uint32_t propertiesLength = propertiesEnd - propertyStart;
-            const uint8_t * pPropertiesLength = reinterpret_cast<const uint8_t*>(&propertiesLength);
-            data[propertiesOffset] = pPropertiesLength[0];
-            data[propertiesOffset + 1] = pPropertiesLength[1];
-            data[propertiesOffset + 2] = pPropertiesLength[2];
-            data[propertiesOffset + 3] = pPropertiesLength[3];
+        write(&header, sizeof(header), 0);
+        write(nodes.data(), nodes.size() * sizeof(SnapshotNode), header.nodes);
+        write(properties.data(), properties.size() * sizeof(SnapshotProperty), header.properties);
+        write(nameTable.data(), nameTable.size() * sizeof(SnapshotName), header.names);
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            write(names[i]->c_str(), names[i]->size() + 1, nameTable[i].offset);
+        }
+        for (size_t i = 0; i < properties.size(); i++)
+        {
+            const Property * pProperty = sources[i];
+            if (pProperty->isPrimitive())
+            {
+                continue;
+            }
 
-            // Add nested list.
-            if (pRecord->size())
+            // Encoded arrays are stored decoded.
+            std::unique_ptr<Property> pDecoded;
+            if (pProperty->isEncoded())
             {
-                stack.push(std::make_tuple(pRecord->begin(), pRecord->end(), 0));
+                pDecoded.reset(new Property(*pProperty));
+                pDecoded->decode();
+                pProperty = pDecoded.get();
             }
-            
+            const uint64_t size = static_cast<uint64_t>(properties[i].size) * elementSize(pProperty->type());
+            const Property::Lease lease(*pProperty);
+            write(size ? lease.data() : zeros, size, properties[i].value);
         }
 
-        file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+        if (file.good() == false)
+        {
+            throw std::runtime_error("Failed to write snapshot.");
+        }
     }
 
+    MemoryResource * Record::resource() const
+    {
+        return m_pResource;
+    }
 
-    const std::string & Record::name() const
+    const String & Record::name() const
     {
         return m_name;
     }
@@ -844,7 +6225,9 @@ namespace Fbx
         {
             throw std::runtime_error("Exceeded record name length limit: " + std::to_string(name.size()));
         }
-        m_name = name;   
+        t_allocations += name.size() > m_name.capacity() ? 1 : 0;
+        m_name.assign(name.begin(), name.end());
+        invalidateMemoryUsage();
     }
 
     Record * Record::parent()
@@ -870,10 +6253,16 @@ namespace Fbx
         {
             parent->insert(this);
         }
+        else
+        {
+            detach();
+        }
     }
 
     PropertyList & Record::properties()
     {
+        // The properties may be changed through the returned list.
+        invalidateMemoryUsage();
         return m_properties;
     }
     const PropertyList & Record::properties() const
@@ -883,112 +6272,201 @@ namespace Fbx
 
     size_t Record::size() const
     {
-        return m_nestedList.size();
+        return m_size;
     }
 
     Record::Iterator Record::insert(Record * record)
     {
-        Record * pParent = record->parent();
-        if (pParent)
-        {
-            pParent->erase(record);
-        }
-
-        record->m_pParent = this;
-        return m_nestedList.insert(m_nestedList.end(), record);
+        return insert(end(), record);
     }
 
     Record::Iterator Record::insert(Iterator position, Record * record)
     {
-        Record * pParent = record->parent();
-        if (pParent)
+        if (record == this)
         {
-            pParent->erase(record);
+            throw std::runtime_error("record == this.");
         }
+        if (*position == record)
+        {
+            return position;
+        }
+
+        record->detach();
+
+        Record * pNext = *position;
+        Record * pPrev = pNext != nullptr ? pNext->m_pPrevSibling : m_pLastChild;
 
         record->m_pParent = this;
-        return m_nestedList.insert(position, record);
+        record->m_pPrevSibling = pPrev;
+        record->m_pNextSibling = pNext;
+        (pPrev != nullptr ? pPrev->m_pNextSibling : m_pFirstChild) = record;
+        (pNext != nullptr ? pNext->m_pPrevSibling : m_pLastChild) = record;
+        ++m_size;
+        invalidateMemoryUsage();
+
+        return Iterator(record, this);
     }
 
     Record::Iterator Record::begin()
     {
-        return m_nestedList.begin();
+        return Iterator(m_pFirstChild, this);
     }
     Record::ConstIterator Record::begin() const
     {
-        return m_nestedList.begin();
+        return ConstIterator(m_pFirstChild, this);
     }
 
     Record::Iterator Record::end()
     {
-        return m_nestedList.end();
+        return Iterator(nullptr, this);
     }
     Record::ConstIterator Record::end() const
     {
-        return m_nestedList.end();
+        return ConstIterator(nullptr, this);
     }
 
     Record * Record::front()
     {
-        return m_nestedList.front();
+        return m_pFirstChild;
     }
     const Record * Record::front() const
     {
-        return m_nestedList.front();
+        return m_pFirstChild;
     }
 
     Record * Record::back()
     {
-        return m_nestedList.back();
+        return m_pLastChild;
     }
     const Record * Record::back() const
     {
-        return m_nestedList.back();
+        return m_pLastChild;
     }
 
     Record::Iterator Record::find(const std::string & p_name)
     {
-        for (auto it = m_nestedList.begin(); it != m_nestedList.end(); it++)
+        for (Record * pChild = m_pFirstChild; pChild != nullptr; pChild = pChild->m_pNextSibling)
         {
-            if ((*it)->name() == p_name)
+            if (nameEquals(pChild->m_name, p_name))
             {
-                return it;
+                return Iterator(pChild, this);
             }
         }
-        return m_nestedList.end();
+        return end();
     }
     Record::ConstIterator Record::find(const std::string & p_name) const
     {
-        for (auto it = m_nestedList.begin(); it != m_nestedList.end(); it++)
+        for (const Record * pChild = m_pFirstChild; pChild != nullptr; pChild = pChild->m_pNextSibling)
         {
-            if ((*it)->name() == p_name)
+            if (nameEquals(pChild->m_name, p_name))
             {
-                return it;
+                return ConstIterator(pChild, this);
             }
         }
-        return m_nestedList.end();
+        return end();
     }
 
     Record::Iterator Record::erase(Record * record)
     {
-        return m_nestedList.end();
+        if (record == nullptr || record->m_pParent != this)
+        {
+            return end();
+        }
+
+        Iterator next(record->m_pNextSibling, this);
+        delete record;
+        return next;
     }
 
     Record::Iterator Record::erase(Iterator position)
     {
-        return m_nestedList.end();
+        return erase(*position);
     }
 
     void Record::clear()
     {
-        for (auto it = m_nestedList.begin(); it != m_nestedList.end(); ++it)
+        Record * pChild = m_pFirstChild;
+        while (pChild != nullptr)
         {
-            delete *it;
+            Record * pNext = pChild->m_pNextSibling;
+            pChild->m_pParent = nullptr;
+            delete pChild;
+            pChild = pNext;
+        }
+
+        m_pFirstChild = nullptr;
+        m_pLastChild = nullptr;
+        m_size = 0;
+        invalidateMemoryUsage();
+    }
+
+    void Record::detach()
+    {
+        if (m_pParent == nullptr)
+        {
+            return;
+        }
+
+        (m_pPrevSibling != nullptr ? m_pPrevSibling->m_pNextSibling : m_pParent->m_pFirstChild) = m_pNextSibling;
+        (m_pNextSibling != nullptr ? m_pNextSibling->m_pPrevSibling : m_pParent->m_pLastChild) = m_pPrevSibling;
+        --m_pParent->m_size;
+        m_pParent->invalidateMemoryUsage();
+
+        m_pParent = nullptr;
+        m_pPrevSibling = nullptr;
+        m_pNextSibling = nullptr;
+    }
+
+    size_t Record::memoryUsage() const
+    {
+        if (m_memoryUsage != 0)
+        {
+            return m_memoryUsage;
+        }
+
+        // Recompute the stale records only, children before their parents.
+        std::vector<const Record *> stale(1, this);
+        for (size_t i = 0; i < stale.size(); i++)
+        {
+            for (const Record * pChild = stale[i]->m_pFirstChild; pChild != nullptr; pChild = pChild->m_pNextSibling)
+            {
+                if (pChild->m_memoryUsage == 0)
+                {
+                    stale.push_back(pChild);
+                }
+            }
+        }
+
+        const size_t inlineName = String(m_pResource).capacity();
+        const size_t listNodeSize = sizeof(Property *) + 2 * sizeof(void *);
+        for (auto it = stale.rbegin(); it != stale.rend(); ++it)
+        {
+            const Record * pRecord = *it;
+            size_t usage = sizeof(Record) + (pRecord->m_name.capacity() > inlineName ? pRecord->m_name.capacity() + 1 : 0);
+            for (const Property * pProperty : pRecord->m_properties)
+            {
+                usage += listNodeSize + pProperty->memoryUsage();
+            }
+            for (const Record * pChild = pRecord->m_pFirstChild; pChild != nullptr; pChild = pChild->m_pNextSibling)
+            {
+                usage += pChild->m_memoryUsage;
+            }
+            pRecord->m_memoryUsage = usage;
+        }
+        return m_memoryUsage;
+    }
+
+    // A stale record has only stale ancestors, so the walk stops at the first one.
+    void Record::invalidateMemoryUsage()
+    {
+        for (Record * pRecord = this; pRecord != nullptr && pRecord->m_memoryUsage != 0; pRecord = pRecord->m_pParent)
+        {
+            pRecord->m_memoryUsage = 0;
         }
-        m_nestedList.clear();
     }
 
-    Record::Record(const Record & record)
+    Record::Record(const Record &) :
+        Record()
     {
     }
 
@@ -26,15 +26,171 @@
 #ifndef FBX_HPP_GUARD
 #define FBX_HPP_GUARD
 
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
 #include <list>
 #include <map>
 #include <vector>
 #include <functional>
+#include <iterator>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <unordered_map>
 
 namespace Fbx
 {
 
+    class MemoryResource
+    {
+
+    public:
+
+        virtual ~MemoryResource();
+
+        virtual void * allocate(const size_t size, const size_t alignment) = 0;
+        virtual void deallocate(void * pointer, const size_t size, const size_t alignment) = 0;
+
+        static MemoryResource * defaultResource();
+
+    };
+
+
+    template<typename T>
+    class Allocator
+    {
+
+    public:
+
+        typedef T value_type;
+
+        Allocator(MemoryResource * resource = nullptr) :
+            m_pResource(resource != nullptr ? resource : MemoryResource::defaultResource())
+        {}
+
+        template<typename U>
+        Allocator(const Allocator<U> & allocator) :
+            m_pResource(allocator.resource())
+        {}
+
+        T * allocate(const size_t count)
+        {
+            return static_cast<T *>(m_pResource->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T * pointer, const size_t count)
+        {
+            m_pResource->deallocate(pointer, count * sizeof(T), alignof(T));
+        }
+
+        MemoryResource * resource() const
+        {
+            return m_pResource;
+        }
+
+    private:
+
+        MemoryResource * m_pResource;
+
+    };
+
+    template<typename T, typename U>
+    bool operator == (const Allocator<T> & a, const Allocator<U> & b)
+    {
+        return a.resource() == b.resource();
+    }
+
+    template<typename T, typename U>
+    bool operator != (const Allocator<T> & a, const Allocator<U> & b)
+    {
+        return a.resource() != b.resource();
+    }
+
+    typedef std::basic_string<char, std::char_traits<char>, Allocator<char>> String;
+
+
+    template<typename T>
+    class Span
+    {
+
+    public:
+
+        typedef T value_type;
+        typedef T * Iterator;
+
+        Span() :
+            m_pData(nullptr),
+            m_size(0)
+        {}
+
+        Span(T * data, const size_t size) :
+            m_pData(data),
+            m_size(size)
+        {}
+
+        Span(T * data, const size_t size, const std::shared_ptr<const void> & owner) :
+            m_pData(data),
+            m_size(size),
+            m_pOwner(owner)
+        {}
+
+        template<typename U>
+        Span(const Span<U> & span) :
+            m_pData(span.data()),
+            m_size(span.size()),
+            m_pOwner(span.owner())
+        {}
+
+        T * data() const
+        {
+            return m_pData;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        T & operator [](const size_t index) const
+        {
+            return m_pData[index];
+        }
+
+        Iterator begin() const
+        {
+            return m_pData;
+        }
+
+        Iterator end() const
+        {
+            return m_pData + m_size;
+        }
+
+        const std::shared_ptr<const void> & owner() const
+        {
+            return m_pOwner;
+        }
+
+    private:
+
+        T *                         m_pData;
+        size_t                      m_size;
+        std::shared_ptr<const void> m_pOwner;   // Keeps the data alive, e.g. a leased paged array.
+
+    };
+
+
+    class ArrayPager;
+
     class Property
     {
 
@@ -50,7 +206,7 @@ namespace Fbx
             double  float64;
         };
 
-        enum class Type
+        enum class Type : uint8_t
         {
             Boolean,
             Integer16,
@@ -67,58 +223,276 @@ namespace Fbx
             Raw
         };
 
-        Property(const bool primitive);
-        Property(const int16_t primitive);
-        Property(const int32_t primitive);
-        Property(const int64_t primitive);
-        Property(const float primitive);
-        Property(const double primitive);
-        Property(const bool * array, const uint32_t count);
-        Property(const int32_t * array, const uint32_t count);
-        Property(const int64_t * array, const uint32_t count);
-        Property(float * array, const uint32_t count);
-        Property(const double * array, const uint32_t count);
-        Property(const char * string);
-        Property(const std::string & string);
-        Property(const uint8_t * raw, const uint32_t size);
+        class ValueArray
+        {
+
+        public:
+
+            ValueArray(const Type type, const uint8_t * data, const uint32_t size);
+            ValueArray(const Type type, const uint8_t * data, const uint32_t size, const std::shared_ptr<const void> & owner);
+
+            Type type() const;
+            const uint8_t * data() const;
+            uint32_t size() const;
+            bool empty() const;
+            Value operator [](const size_t index) const;
+
+        private:
+
+            Type                        m_type;
+            uint32_t                    m_size;
+            const uint8_t *             m_pData;
+            std::shared_ptr<const void> m_pOwner;
+
+        };
+
+        class Lease
+        {
+
+        public:
+
+            Lease();
+            explicit Lease(const Property & property);
+            Lease(Lease && lease);
+            ~Lease();
+
+            Lease & operator = (Lease && lease);
+
+            const void * data() const;
+            ValueArray array() const;
+            template<typename T> Span<const T> getArray() const;
+
+        private:
+
+            Lease(const Lease &);
+            Lease & operator = (const Lease &);
+
+            void unpin();
+
+            const Property *    m_pProperty;
+            const void *        m_pData;
+            void *              m_pPage;    // Pinned page of a paged array.
+
+        };
+
+        Property(const bool primitive, MemoryResource * resource = nullptr);
+        Property(const int16_t primitive, MemoryResource * resource = nullptr);
+        Property(const int32_t primitive, MemoryResource * resource = nullptr);
+        Property(const int64_t primitive, MemoryResource * resource = nullptr);
+        Property(const float primitive, MemoryResource * resource = nullptr);
+        Property(const double primitive, MemoryResource * resource = nullptr);
+        Property(const bool * array, const uint32_t count, MemoryResource * resource = nullptr);
+        Property(const int32_t * array, const uint32_t count, MemoryResource * resource = nullptr);
+        Property(const int64_t * array, const uint32_t count, MemoryResource * resource = nullptr);
+        Property(const float * array, const uint32_t count, MemoryResource * resource = nullptr);
+        Property(const double * array, const uint32_t count, MemoryResource * resource = nullptr);
+        Property(const char * string, MemoryResource * resource = nullptr);
+        Property(const std::string & string, MemoryResource * resource = nullptr);
+        Property(const uint8_t * raw, const uint32_t size, MemoryResource * resource = nullptr);
+        Property(const Type type, const uint32_t size, MemoryResource * resource = nullptr);
+        Property(const Type type, const uint32_t size, const uint8_t * encoded, const uint32_t encodedSize, MemoryResource * resource = nullptr);
+        Property(const Property & property);
+        Property(Property && property);
+        ~Property();
+
+        Property & operator = (const Property & property);
+        Property & operator = (Property && property);
+
+        static void * operator new(size_t size);
+        static void * operator new(size_t size, MemoryResource * resource);
+        static void operator delete(void * pointer, size_t size);
+        static void operator delete(void * pointer, MemoryResource * resource);
 
         Type type() const;
         uint8_t code() const;
         Value & primitive();
         const Value & primitive() const;
-        std::vector<Value> & array();
-        const std::vector<Value> & array() const;
+        template<typename T> T get() const;
+        template<typename T> void set(const T value);
+        ValueArray array() const;
+        template<typename T> Span<T> getArray();
+        template<typename T> Span<const T> getArray() const;
         std::string string() const;
-        std::vector<uint8_t> & raw();
-        const std::vector<uint8_t> & raw() const;
+        Span<uint8_t> raw();
+        Span<const uint8_t> raw() const;
+        Span<uint8_t> encoded();
+        Span<const uint8_t> encoded() const;
+        void decode();
+        uint32_t convert(float * output, const size_t components = 1, float * minimum = nullptr, float * maximum = nullptr) const;
+        void * data();
+        const void * data() const;
+        Lease lease() const;
         uint32_t size() const;
+        MemoryResource * resource() const;
+        size_t memoryUsage() const;
 
         bool isPrimitive() const;
         bool isArray() const;
         bool isString() const;
         bool isRaw() const;
+        bool isEncoded() const;
+        bool isPaged() const;
 
     private:
 
-        Type                    m_type;
-        Value                   m_primitive;
-        std::vector<Value>      m_array;
-        std::vector<uint8_t>    m_raw;
+        friend class ArrayPager;
+
+        void allocate(const size_t size);
+        void release();
+        void checkType(const Type type) const;
+        size_t storageSize() const;
+        const void * leasedData(std::shared_ptr<const void> & lease) const;
+
+        Type                m_type;
+        bool                m_encoded;
+        bool                m_paged;
+        uint32_t            m_size;
+        union
+        {
+            Value           m_primitive;
+            uint8_t *       m_pData;
+        };
+        MemoryResource *    m_pResource;
+
+    };
+
+
+    template<typename T>
+    struct PropertyTraits
+    {
+        static constexpr bool isPrimitive = false;
+        static constexpr bool isArray = false;
+    };
+
+    template<typename T>
+    constexpr bool PropertyTraits<T>::isPrimitive;
+
+    template<typename T>
+    constexpr bool PropertyTraits<T>::isArray;
+
+    template<>
+    struct PropertyTraits<bool>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = true;
+        static constexpr Property::Type type = Property::Type::Boolean;
+        static constexpr Property::Type arrayType = Property::Type::BooleanArray;
+        static constexpr uint8_t code = 'C';
+        static constexpr uint8_t arrayCode = 'b';
+    };
+
+    template<>
+    struct PropertyTraits<int16_t>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = false;
+        static constexpr Property::Type type = Property::Type::Integer16;
+        static constexpr uint8_t code = 'Y';
+    };
+
+    template<>
+    struct PropertyTraits<int32_t>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = true;
+        static constexpr Property::Type type = Property::Type::Integer32;
+        static constexpr Property::Type arrayType = Property::Type::Integer32Array;
+        static constexpr uint8_t code = 'I';
+        static constexpr uint8_t arrayCode = 'i';
+    };
 
+    template<>
+    struct PropertyTraits<int64_t>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = true;
+        static constexpr Property::Type type = Property::Type::Integer64;
+        static constexpr Property::Type arrayType = Property::Type::Integer64Array;
+        static constexpr uint8_t code = 'L';
+        static constexpr uint8_t arrayCode = 'l';
     };
 
+    template<>
+    struct PropertyTraits<float>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = true;
+        static constexpr Property::Type type = Property::Type::Float32;
+        static constexpr Property::Type arrayType = Property::Type::Float32Array;
+        static constexpr uint8_t code = 'F';
+        static constexpr uint8_t arrayCode = 'f';
+    };
+
+    template<>
+    struct PropertyTraits<double>
+    {
+        static constexpr bool isPrimitive = true;
+        static constexpr bool isArray = true;
+        static constexpr Property::Type type = Property::Type::Float64;
+        static constexpr Property::Type arrayType = Property::Type::Float64Array;
+        static constexpr uint8_t code = 'D';
+        static constexpr uint8_t arrayCode = 'd';
+    };
+
+    template<typename T>
+    T Property::get() const
+    {
+        static_assert(PropertyTraits<T>::isPrimitive, "Type is not an FBX primitive.");
+        checkType(PropertyTraits<T>::type);
+        return *static_cast<const T *>(data());
+    }
+
+    template<typename T>
+    void Property::set(const T value)
+    {
+        static_assert(PropertyTraits<T>::isPrimitive, "Type is not an FBX primitive.");
+        checkType(PropertyTraits<T>::type);
+        *static_cast<T *>(data()) = value;
+    }
+
+    template<typename T>
+    Span<T> Property::getArray()
+    {
+        static_assert(PropertyTraits<T>::isArray, "Type is not an FBX array element.");
+        checkType(PropertyTraits<T>::arrayType);
+        return Span<T>(static_cast<T *>(data()), m_size);
+    }
+
+    template<typename T>
+    Span<const T> Property::getArray() const
+    {
+        static_assert(PropertyTraits<T>::isArray, "Type is not an FBX array element.");
+        checkType(PropertyTraits<T>::arrayType);
+        std::shared_ptr<const void> lease;
+        const T * pData = static_cast<const T *>(leasedData(lease));
+        return Span<const T>(pData, m_size, lease);
+    }
+
+    template<typename T>
+    Span<const T> Property::Lease::getArray() const
+    {
+        static_assert(PropertyTraits<T>::isArray, "Type is not an FBX array element.");
+        if (m_pProperty == nullptr)
+        {
+            throw std::runtime_error("Lease holds no property.");
+        }
+        m_pProperty->checkType(PropertyTraits<T>::arrayType);
+        return Span<const T>(static_cast<const T *>(m_pData), m_pProperty->m_size);
+    }
+
 
     class PropertyList
     {
 
     public:
 
-        typedef std::list<Property *>::iterator Iterator;
-        typedef std::list<Property *>::const_iterator ConstIterator;
+        typedef std::list<Property *, Allocator<Property *>>::iterator Iterator;
+        typedef std::list<Property *, Allocator<Property *>>::const_iterator ConstIterator;
 
-        PropertyList();
+        PropertyList(MemoryResource * resource = nullptr);
         ~PropertyList();
 
+        MemoryResource * resource() const;
         size_t size() const;
         Iterator insert(Property * property);
         Iterator insert(Iterator position, Property * property);
@@ -138,30 +512,194 @@ namespace Fbx
 
         PropertyList(PropertyList &);
 
-        std::list<Property *> m_properties;
+        std::list<Property *, Allocator<Property *>> m_properties;
+
+    };
+
+
+    class OperationCanceled : public std::runtime_error
+    {
+
+    public:
+
+        OperationCanceled();
+
+    };
+
+    struct Statistics
+    {
+        Statistics();
+
+        void forEach(const std::function<void(const std::string &, double)> & function) const;
+
+        uint64_t    bytesRead;
+        uint64_t    bytesWritten;
+        uint64_t    compressedBytes;
+        uint64_t    decompressedBytes;
+        uint64_t    records;
+        uint64_t    properties;
+        uint64_t    allocations;
+        double      ioSeconds;
+        double      inflateSeconds;
+        double      deflateSeconds;
+        double      buildSeconds;
+        double      serializeSeconds;
+        double      totalSeconds;
+    };
+
+    struct ReadOptions
+    {
+        ReadOptions() :
+            deferArrays(false),
+            memoryBudget(0),
+            statistics(nullptr),
+            progressInterval(1 << 20)
+        {}
 
+        std::function<void(std::string, uint32_t)> onHeaderRead;
+        bool deferArrays;
+        size_t memoryBudget;
+        Statistics * statistics;
+        std::function<void(const Statistics &)> onStatistics;
+        std::function<bool(uint64_t, uint64_t)> onProgress;
+        uint64_t progressInterval;
     };
 
+    struct WriteOptions
+    {
+        WriteOptions() :
+            version(7100),
+            statistics(nullptr),
+            progressInterval(1 << 20)
+        {}
+
+        uint32_t version;
+        Statistics * statistics;
+        std::function<void(const Statistics &)> onStatistics;
+        std::function<bool(uint64_t, uint64_t)> onProgress;
+        uint64_t progressInterval;
+    };
+
+    void startTrace();
+    void stopTrace(const std::string & filename);
+
 
     class Record
     {
 
     public:
 
-        typedef std::list<Record *>::iterator Iterator;
-        typedef std::list<Record *>::const_iterator ConstIterator;
+        template<typename T>
+        class BasicIterator
+        {
+
+        public:
+
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef T * value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef T * const * pointer;
+            typedef T * reference;
+
+            BasicIterator() :
+                m_pRecord(nullptr),
+                m_pOwner(nullptr)
+            {}
+
+            BasicIterator(T * record, T * owner) :
+                m_pRecord(record),
+                m_pOwner(owner)
+            {}
+
+            template<typename U>
+            BasicIterator(const BasicIterator<U> & iterator) :
+                m_pRecord(*iterator),
+                m_pOwner(iterator.owner())
+            {}
+
+            T * operator * () const
+            {
+                return m_pRecord;
+            }
+
+            T * owner() const
+            {
+                return m_pOwner;
+            }
+
+            BasicIterator & operator ++ ()
+            {
+                m_pRecord = m_pRecord->m_pNextSibling;
+                return *this;
+            }
+
+            BasicIterator operator ++ (int)
+            {
+                BasicIterator copy(*this);
+                ++(*this);
+                return copy;
+            }
+
+            BasicIterator & operator -- ()
+            {
+                m_pRecord = m_pRecord != nullptr ? m_pRecord->m_pPrevSibling : m_pOwner->m_pLastChild;
+                return *this;
+            }
+
+            BasicIterator operator -- (int)
+            {
+                BasicIterator copy(*this);
+                --(*this);
+                return copy;
+            }
+
+            bool operator == (const BasicIterator & iterator) const
+            {
+                return m_pRecord == iterator.m_pRecord;
+            }
+
+            bool operator != (const BasicIterator & iterator) const
+            {
+                return m_pRecord != iterator.m_pRecord;
+            }
+
+        private:
+
+            T * m_pRecord;
+            T * m_pOwner;
+
+        };
+
+        typedef BasicIterator<Record> Iterator;
+        typedef BasicIterator<const Record> ConstIterator;
 
         Record();
+        explicit Record(MemoryResource * resource);
         Record(const std::string & name);
         Record(const std::string & name, Record * parent);
         ~Record();
 
+        static void * operator new(size_t size);
+        static void * operator new(size_t size, MemoryResource * resource);
+        static void operator delete(void * pointer, size_t size);
+        static void operator delete(void * pointer, MemoryResource * resource);
+
         void read(const std::string & filename);
         void read(const std::string & filename, std::function<void(std::string, uint32_t)> onHeaderRead);
+        void read(const std::string & filename, const ReadOptions & options);
+        void read(std::istream & stream, const ReadOptions & options);
+        void readZip(const std::string & archive, const std::string & entry);
+        void readZip(const std::string & archive, const std::string & entry, const ReadOptions & options);
         void write(const std::string & filename) const;
         void write(const std::string & filename, const uint32_t version) const;
+        void write(const std::string & filename, const WriteOptions & options) const;
+        void writeZip(const std::string & archive, const std::string & entry) const;
+        void writeZip(const std::string & archive, const std::string & entry, const uint32_t version) const;
+        void writeZip(const std::string & archive, const std::string & entry, const WriteOptions & options) const;
+        void writeSnapshot(const std::string & filename) const;
 
-        const std::string & name() const;
+        MemoryResource * resource() const;
+        const String & name() const;
         void name(const std::string & name);
         Record * parent();
         const Record * parent() const;
@@ -186,17 +724,612 @@ namespace Fbx
         Iterator erase(Iterator position);
         void clear();
 
+        size_t memoryUsage() const;
+
     private:
         
         Record(const Record &);
 
-        std::string         m_name;
+        void read(std::istream & stream, const ReadOptions & options, ArrayPager * pager);
+        void detach();
+        void invalidateMemoryUsage();
+
+        MemoryResource *    m_pResource;
+        String              m_name;
         Record *            m_pParent;
+        Record *            m_pFirstChild;
+        Record *            m_pLastChild;
+        Record *            m_pPrevSibling;
+        Record *            m_pNextSibling;
+        size_t              m_size;
         PropertyList        m_properties;
-        std::list<Record *> m_nestedList;
+        mutable size_t      m_memoryUsage;  // Subtree usage, 0 when stale.
+
+    };
+
+    class ObjectIndex
+    {
+
+    public:
+
+        ObjectIndex();
+        explicit ObjectIndex(Record & record);
+
+        void build(Record & record);
+        size_t size() const;
+        Record * find(const int64_t uid);
+        const Record * find(const int64_t uid) const;
+        void clear();
+
+    private:
+
+        struct Entry
+        {
+            int64_t     uid;
+            Record *    record;
+        };
+
+        size_t slot(const int64_t uid) const;
+
+        std::vector<Entry>  m_entries;
+        size_t              m_size;
+
+    };
+
+
+    class ConnectionGraph
+    {
+
+    public:
+
+        enum class Type : uint8_t
+        {
+            ObjectObject,
+            ObjectProperty,
+            PropertyObject,
+            PropertyProperty
+        };
+
+        struct Connection
+        {
+            int64_t     uid;
+            Type        type;
+            uint32_t    childProperty;
+            uint32_t    parentProperty;
+        };
+
+        ConnectionGraph();
+        explicit ConnectionGraph(const Record & record);
+
+        void build(const Record & record);
+        size_t size() const;
+        bool contains(const int64_t uid) const;
+        Span<const Connection> children(const int64_t uid) const;
+        Span<const Connection> parents(const int64_t uid) const;
+        const std::string & label(const uint32_t index) const;
+        void clear();
+
+    private:
+
+        size_t slot(const int64_t uid) const;
+        uint32_t node(const int64_t uid) const;
+
+        std::vector<int64_t>        m_uids;
+        std::vector<uint32_t>       m_slots;
+        std::vector<uint32_t>       m_childOffsets;
+        std::vector<Connection>     m_children;
+        std::vector<uint32_t>       m_parentOffsets;
+        std::vector<Connection>     m_parents;
+        std::vector<std::string>    m_labels;
 
     };
 
+
+    class PropertyTable
+    {
+
+    public:
+
+        enum class Kind : uint8_t
+        {
+            None,
+            Integer,
+            Number,
+            Vector,
+            String
+        };
+
+        struct Entry
+        {
+            uint32_t            name;
+            Kind                kind;
+            uint8_t             count;
+            Span<const char>    type;
+            Span<const char>    flags;
+            Span<const char>    string;
+            int64_t             integer;
+            double              values[4];
+        };
+
+        PropertyTable();
+        explicit PropertyTable(const Record & record, const PropertyTable * defaults = nullptr);
+
+        static uint32_t intern(const std::string & name);
+
+        void reset(const Record & record, const PropertyTable * defaults = nullptr);
+        size_t size() const;
+        const Entry * find(const uint32_t name) const;
+        const Entry * find(const std::string & name) const;
+        int64_t integer(const uint32_t name, const int64_t defaultValue) const;
+        double number(const uint32_t name, const double defaultValue) const;
+        bool vector(const uint32_t name, double values[3]) const;
+
+    private:
+
+        void build();
+
+        const Record *                  m_pProperties;
+        const PropertyTable *           m_pDefaults;
+        std::vector<Entry>              m_entries;
+        std::vector<uint32_t>           m_slots;
+
+    };
+
+
+    struct Triangulation
+    {
+        std::vector<uint32_t>   polygons;
+        std::vector<uint32_t>   indices;
+    };
+
+    Triangulation triangulate(const Span<const int32_t> & polygonVertexIndex, const Span<const double> & vertices = Span<const double>(), const unsigned int threads = 0);
+
+
+    struct Mesh
+    {
+        std::vector<float>      positions;
+        std::vector<float>      normals;
+        std::vector<float>      uvs;
+        std::vector<float>      colors;
+        std::vector<uint32_t>   indices;
+    };
+
+    Mesh extractMesh(const Record & geometry, const unsigned int threads = 0);
+
+
+    struct SkinWeights
+    {
+        uint32_t                influences;
+        std::vector<int64_t>    bones;
+        std::vector<uint32_t>   joints;
+        std::vector<float>      weights;
+    };
+
+    SkinWeights extractSkin(const Record & skin, const ObjectIndex & objects, const ConnectionGraph & connections, const uint32_t influences = 4, const unsigned int threads = 0);
+
+
+    class AnimationCurve
+    {
+
+    public:
+
+        static const int64_t ticksPerSecond = 46186158000LL;
+
+        enum class Interpolation : uint8_t
+        {
+            Constant,
+            ConstantNext,
+            Linear,
+            Cubic
+        };
+
+        AnimationCurve();
+        explicit AnimationCurve(const Record & curve);
+
+        void load(const Record & curve);
+        size_t size() const;
+        Span<const int64_t> times() const;
+        Span<const float> values() const;
+        Span<const Interpolation> interpolations() const;
+        float evaluate(const int64_t time) const;
+        void sample(const int64_t start, const int64_t step, const size_t count, float * output) const;
+
+    private:
+
+        float                       m_default;
+        std::vector<int64_t>        m_times;
+        std::vector<float>          m_values;
+        std::vector<Interpolation>  m_interpolations;
+        std::vector<float>          m_rightSlopes;
+        std::vector<float>          m_nextLeftSlopes;
+
+    };
+
+
+    struct BakedAnimation
+    {
+        struct Channel
+        {
+            int64_t     node;
+            std::string property;
+            uint32_t    component;
+        };
+
+        int64_t                 start;
+        int64_t                 step;
+        uint32_t                frames;
+        std::vector<Channel>    channels;
+        std::vector<float>      samples;
+    };
+
+    BakedAnimation bakeAnimation(const Record & stack, const ObjectIndex & objects, const ConnectionGraph & connections, const double frameRate = 30.0, const unsigned int threads = 0);
+
+
+    struct SceneTransforms
+    {
+        std::vector<int64_t>    nodes;
+        std::vector<int32_t>    parents;
+        std::vector<double>     local;
+        std::vector<double>     world;
+    };
+
+    SceneTransforms evaluateTransforms(const Record & file, const ConnectionGraph & connections, const unsigned int threads = 0);
+
+
+    struct EmbeddedMedia
+    {
+        int64_t     uid;
+        std::string name;
+        std::string filename;
+        uint64_t    offset;
+        uint32_t    size;
+    };
+
+    std::vector<EmbeddedMedia> listEmbeddedMedia(const std::string & filename);
+    void extractEmbeddedMedia(const std::string & filename, const EmbeddedMedia & media, const int fd);
+
+
+    class Snapshot;
+
+    template<typename View>
+    class ViewRange
+    {
+
+    public:
+
+        class Iterator
+        {
+
+        public:
+
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef View value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const View * pointer;
+            typedef View reference;
+
+            Iterator() :
+                m_pSnapshot(nullptr),
+                m_index(0)
+            {}
+
+            Iterator(const Snapshot * snapshot, const uint32_t index) :
+                m_pSnapshot(snapshot),
+                m_index(index)
+            {}
+
+            View operator * () const
+            {
+                return View(m_pSnapshot, m_index);
+            }
+
+            Iterator & operator ++ ()
+            {
+                ++m_index;
+                return *this;
+            }
+
+            Iterator operator ++ (int)
+            {
+                Iterator copy(*this);
+                ++m_index;
+                return copy;
+            }
+
+            Iterator & operator -- ()
+            {
+                --m_index;
+                return *this;
+            }
+
+            Iterator operator -- (int)
+            {
+                Iterator copy(*this);
+                --m_index;
+                return copy;
+            }
+
+            bool operator == (const Iterator & iterator) const
+            {
+                return m_index == iterator.m_index && m_pSnapshot == iterator.m_pSnapshot;
+            }
+
+            bool operator != (const Iterator & iterator) const
+            {
+                return !(*this == iterator);
+            }
+
+        private:
+
+            const Snapshot *    m_pSnapshot;
+            uint32_t            m_index;
+
+        };
+
+        ViewRange(const Snapshot * snapshot, const uint32_t first, const uint32_t count) :
+            m_pSnapshot(snapshot),
+            m_first(first),
+            m_count(count)
+        {}
+
+        Iterator begin() const
+        {
+            return Iterator(m_pSnapshot, m_first);
+        }
+
+        Iterator end() const
+        {
+            return Iterator(m_pSnapshot, m_first + m_count);
+        }
+
+        size_t size() const
+        {
+            return m_count;
+        }
+
+        bool empty() const
+        {
+            return m_count == 0;
+        }
+
+        View operator [](const size_t index) const
+        {
+            if (index >= m_count)
+            {
+                throw std::runtime_error("View index out of range.");
+            }
+            return View(m_pSnapshot, m_first + static_cast<uint32_t>(index));
+        }
+
+        View front() const
+        {
+            return (*this)[0];
+        }
+
+        View back() const
+        {
+            return (*this)[m_count - 1];
+        }
+
+    private:
+
+        const Snapshot *    m_pSnapshot;
+        uint32_t            m_first;
+        uint32_t            m_count;
+
+    };
+
+    class PropertyView
+    {
+
+    public:
+
+        PropertyView(const Snapshot * snapshot, const uint32_t index);
+
+        Property::Type type() const;
+        uint8_t code() const;
+        uint32_t size() const;
+        Property::Value primitive() const;
+        template<typename T> T get() const;
+        Property::ValueArray array() const;
+        template<typename T> Span<const T> getArray() const;
+        std::string string() const;
+        Span<const uint8_t> raw() const;
+        const void * data() const;
+
+        bool isPrimitive() const;
+        bool isArray() const;
+        bool isString() const;
+        bool isRaw() const;
+
+    private:
+
+        void checkType(const Property::Type type) const;
+
+        const Snapshot *    m_pSnapshot;
+        uint32_t            m_index;
+
+    };
+
+    template<typename T>
+    T PropertyView::get() const
+    {
+        static_assert(PropertyTraits<T>::isPrimitive, "Type is not an FBX primitive.");
+        checkType(PropertyTraits<T>::type);
+        return *static_cast<const T *>(data());
+    }
+
+    template<typename T>
+    Span<const T> PropertyView::getArray() const
+    {
+        static_assert(PropertyTraits<T>::isArray, "Type is not an FBX array element.");
+        checkType(PropertyTraits<T>::arrayType);
+        return Span<const T>(static_cast<const T *>(data()), size());
+    }
+
+    class RecordView
+    {
+
+    public:
+
+        typedef ViewRange<RecordView>::Iterator Iterator;
+
+        RecordView(const Snapshot * snapshot, const uint32_t index);
+
+        const char * name() const;
+        bool hasParent() const;
+        RecordView parent() const;
+        ViewRange<PropertyView> properties() const;
+
+        size_t size() const;
+        Iterator begin() const;
+        Iterator end() const;
+        RecordView front() const;
+        RecordView back() const;
+        Iterator find(const std::string & name) const;
+
+    private:
+
+        ViewRange<RecordView> children() const;
+
+        const Snapshot *    m_pSnapshot;
+        uint32_t            m_index;
+
+    };
+
+    class Snapshot
+    {
+
+    public:
+
+        Snapshot();
+        explicit Snapshot(const std::string & filename);
+        Snapshot(const void * data, const size_t size);
+        ~Snapshot();
+
+        void open(const std::string & filename);
+        void open(const void * data, const size_t size);
+        void close();
+        bool isOpen() const;
+        size_t size() const;
+        RecordView root() const;
+
+    private:
+
+        friend class RecordView;
+        friend class PropertyView;
+
+        Snapshot(const Snapshot &);
+        Snapshot & operator = (const Snapshot &);
+
+        void attach(const uint8_t * data, const size_t size);
+        const void * node(const uint32_t index) const;
+        const void * property(const uint32_t index) const;
+        const char * name(const uint32_t index) const;
+        const uint8_t * payload(const uint64_t offset, const uint64_t size) const;
+
+        const uint8_t *     m_pData;
+        size_t              m_size;
+        void *              m_pMapping;     // Mapped file or buffer owned by the snapshot.
+        uint32_t            m_nodeCount;
+        uint32_t            m_propertyCount;
+        uint32_t            m_nameCount;
+
+    };
+
+
+    class Document
+    {
+
+    public:
+
+        explicit Document(Record * record);
+        explicit Document(const std::string & filename, const ReadOptions & options = ReadOptions());
+        ~Document();
+
+        const Record & root() const;
+        const void * data(const Property & property) const;
+        Property::ValueArray array(const Property & property) const;
+        template<typename T> Span<const T> getArray(const Property & property) const;
+        size_t memoryUsage() const;
+
+    private:
+
+        Document(const Document &);
+        Document & operator = (const Document &);
+
+        void freeze();
+        void checkType(const Property & property, const Property::Type type) const;
+
+        std::unique_ptr<Record>                             m_pRoot;
+        std::unordered_map<const Property *, size_t>        m_encoded;
+        std::unique_ptr<std::atomic<uint8_t *>[]>           m_pInflated;    // Published once per encoded property.
+        size_t                                              m_usage;
+        mutable std::atomic<size_t>                         m_inflatedUsage;
+
+    };
+
+    template<typename T>
+    Span<const T> Document::getArray(const Property & property) const
+    {
+        static_assert(PropertyTraits<T>::isArray, "Type is not an FBX array element.");
+        checkType(property, PropertyTraits<T>::arrayType);
+        return Span<const T>(static_cast<const T *>(data(property)), property.size());
+    }
+
+
+    class DocumentCache
+    {
+
+    public:
+
+        explicit DocumentCache(const size_t capacity, const ReadOptions & options = ReadOptions());
+
+        std::shared_ptr<const Document> load(const std::string & filename);
+        size_t size() const;
+        size_t capacity() const;
+        size_t memoryUsage() const;
+        void clear();
+
+    private:
+
+        DocumentCache(const DocumentCache &);
+        DocumentCache & operator = (const DocumentCache &);
+
+        struct Identity
+        {
+            uint64_t    size;
+            int64_t     modified;   // Nanoseconds since the epoch.
+            uint64_t    inode;
+            uint64_t    device;
+        };
+
+        struct Entry
+        {
+            Identity                                                identity;
+            uint64_t                                                generation;
+            std::shared_future<std::shared_ptr<const Document>>     document;
+            size_t                                                  usage;      // 0 while loading.
+            std::list<std::string>::iterator                        recent;
+        };
+
+        void evict();
+
+        size_t                                      m_capacity;
+        ReadOptions                                 m_options;
+        mutable std::mutex                          m_mutex;
+        std::mutex                                  m_callbackMutex;
+        std::unordered_map<std::string, Entry>      m_entries;
+        std::list<std::string>                      m_recent;       // Most recently used first.
+        size_t                                      m_usage;
+        uint64_t                                    m_generation;
+
+    };
+
+
+    void validate(const std::string & filename);
+    void validate(const std::string & filename, const bool verifyChecksums);
+
 }
 
 #endif
\ No newline at end of file
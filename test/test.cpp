@@ -1,5 +1,9 @@
 #include "gtest/gtest.h"
 #include "../fbx.hpp"
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 using namespace Fbx;
 
@@ -153,6 +157,1598 @@ TEST(Property, Value)
     }
 }
 
+TEST(Property, Storage)
+{
+    EXPECT_LE(sizeof(Property), 24);
+
+    double array[3] = { 1.0, 2.0, 3.0 };
+    Property p1(array, 3);
+    Property p2(p1);
+    EXPECT_EQ(p2.type(), Property::Type::Float64Array);
+    EXPECT_EQ(p2.size(), 3);
+    EXPECT_NE(p1.data(), p2.data());
+    EXPECT_EQ(p2.array()[2].float64, 3.0);
+
+    Property p3(std::move(p2));
+    EXPECT_EQ(p3.size(), 3);
+    EXPECT_EQ(p2.size(), 0);
+    EXPECT_EQ(p3.array()[1].float64, 2.0);
+
+    p3 = Property("Hello");
+    EXPECT_TRUE(p3.isString());
+    EXPECT_STREQ(p3.string().c_str(), "Hello");
+    EXPECT_EQ(p3.array().size(), 0);
+
+    p1 = p3;
+    EXPECT_STREQ(p1.string().c_str(), "Hello");
+    EXPECT_EQ(p1.raw().size(), 5);
+}
+
+TEST(Property, TypedAccess)
+{
+    static_assert(PropertyTraits<double>::code == 'D', "Invalid code.");
+    static_assert(PropertyTraits<int32_t>::arrayCode == 'i', "Invalid code.");
+    static_assert(PropertyTraits<int16_t>::isArray == false, "Invalid traits.");
+
+    Property p1((int64_t)123456789012);
+    EXPECT_EQ(p1.get<int64_t>(), 123456789012);
+    EXPECT_THROW(p1.get<int32_t>(), std::runtime_error);
+    p1.set<int64_t>(42);
+    EXPECT_EQ(p1.primitive().integer64, 42);
+
+    float array[4] = { 1.0f, 2.0f, 3.0f, 4.0f };
+    Property p2(array, 4);
+    Span<const float> values = static_cast<const Property &>(p2).getArray<float>();
+    EXPECT_EQ(values.size(), 4);
+    EXPECT_EQ(values[3], 4.0f);
+    EXPECT_THROW(p2.getArray<double>(), std::runtime_error);
+
+    for (auto & value : p2.getArray<float>())
+    {
+        value *= 2.0f;
+    }
+    EXPECT_EQ(p2.array()[1].float32, 4.0f);
+    EXPECT_EQ(p2.code(), PropertyTraits<float>::arrayCode);
+}
+
+bool recordsEqual(const Record * a, const Record * b)
+{
+    if (a->name() != b->name() || a->size() != b->size() || a->properties().size() != b->properties().size())
+    {
+        return false;
+    }
+
+    for (auto pa = a->properties().begin(), pb = b->properties().begin(); pa != a->properties().end(); ++pa, ++pb)
+    {
+        if ((*pa)->type() != (*pb)->type() || (*pa)->size() != (*pb)->size())
+        {
+            return false;
+        }
+        if ((*pa)->isArray())
+        {
+            for (uint32_t i = 0; i < (*pa)->size(); ++i)
+            {
+                const Property::Value va = (*pa)->array()[i];
+                const Property::Value vb = (*pb)->array()[i];
+                if (memcmp(&va, &vb, sizeof(Property::Value)) != 0)
+                {
+                    return false;
+                }
+            }
+        }
+        else if ((*pa)->string() != (*pb)->string())
+        {
+            return false;
+        }
+    }
+
+    for (auto ra = a->begin(), rb = b->begin(); ra != a->end(); ++ra, ++rb)
+    {
+        if (recordsEqual(*ra, *rb) == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(Record, RoundTrip)
+{
+    Record file1;
+    Record file2;
+
+    EXPECT_NO_THROW(file1.read("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(file1.write("../bin/blender-roundtrip-test.fbx"));
+    EXPECT_NO_THROW(file2.read("../bin/blender-roundtrip-test.fbx"));
+    EXPECT_TRUE(recordsEqual(&file1, &file2));
+
+    auto vertices = *(*(*file2.find("Objects"))->find("Geometry"))->find("Vertices");
+    EXPECT_EQ(vertices->properties().front()->getArray<double>().size(), 24);
+}
+
+TEST(Record, Children)
+{
+    Record root;
+    Record * pA = new Record("A", &root);
+    Record * pB = new Record("B", &root);
+    Record * pC = *root.insert(root.find("B"), new Record("C"));
+    EXPECT_EQ(root.size(), 3);
+    EXPECT_EQ(root.front(), pA);
+    EXPECT_EQ(root.back(), pB);
+    EXPECT_EQ(*(++root.begin()), pC);
+    EXPECT_EQ(*(--root.end()), pB);
+
+    // Inserting a record before itself leaves the list as it is.
+    EXPECT_EQ(*root.insert(root.find("C"), pC), pC);
+    EXPECT_EQ(root.size(), 3);
+    EXPECT_EQ(*(++root.begin()), pC);
+    EXPECT_EQ(*(++(++root.begin())), pB);
+    EXPECT_EQ(*(--(--root.end())), pC);
+
+    auto it = root.erase(pC);
+    EXPECT_EQ(*it, pB);
+    EXPECT_EQ(root.size(), 2);
+    EXPECT_TRUE(root.find("C") == root.end());
+
+    pA->insert(pB);
+    EXPECT_EQ(root.size(), 1);
+    EXPECT_EQ(pA->size(), 1);
+    EXPECT_EQ(pB->parent(), pA);
+
+    pB->parent(nullptr);
+    EXPECT_EQ(pA->size(), 0);
+    EXPECT_EQ(pB->parent(), nullptr);
+    delete pB;
+
+    pA->properties().insert(new Property((int32_t)1));
+    pA->properties().insert(new Property((int32_t)2));
+    pA->properties().erase(pA->properties().front());
+    EXPECT_EQ(pA->properties().size(), 1);
+    EXPECT_EQ(pA->properties().front()->primitive().integer32, 2);
+
+    EXPECT_TRUE(root.erase(root.begin()) == root.end());
+    EXPECT_EQ(root.size(), 0);
+}
+
+TEST(Record, Validate)
+{
+    EXPECT_NO_THROW(validate("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(validate("../models/blender-default.fbx", true));
+    EXPECT_THROW(validate("../bin/missing-file.fbx"), std::runtime_error);
+
+    // Single record holding one compressed array.
+    std::vector<double> values(1000, 1.0);
+    Record file;
+    Record * pRecord = new Record("Array", &file);
+    pRecord->properties().insert(new Property(values.data(), static_cast<uint32_t>(values.size())));
+    EXPECT_NO_THROW(file.write("../bin/validate-test.fbx"));
+    EXPECT_NO_THROW(validate("../bin/validate-test.fbx", true));
+
+    std::vector<char> data;
+    {
+        std::ifstream input("../bin/validate-test.fbx", std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    auto writeCopy = [](const std::vector<char> & bytes)
+    {
+        std::ofstream output("../bin/validate-test-corrupt.fbx", std::ios::binary);
+        output.write(bytes.data(), bytes.size());
+    };
+
+    const size_t payloadOffset = 27 + 13 + 5 + 13;
+    uint32_t compressedLength = 0;
+    memcpy(&compressedLength, &data[payloadOffset - 4], 4);
+
+    // Corrupt checksum is only detected when verifying checksums.
+    std::vector<char> corrupt(data);
+    corrupt[payloadOffset + compressedLength - 1] ^= 0x55;
+    writeCopy(corrupt);
+    EXPECT_NO_THROW(validate("../bin/validate-test-corrupt.fbx"));
+    EXPECT_THROW(validate("../bin/validate-test-corrupt.fbx", true), std::runtime_error);
+
+    // Invalid magic.
+    corrupt = data;
+    corrupt[0] = 'X';
+    writeCopy(corrupt);
+    EXPECT_THROW(validate("../bin/validate-test-corrupt.fbx"), std::runtime_error);
+
+    // End offset exceeding file.
+    corrupt = data;
+    corrupt[27 + 3] = 0x7F;
+    writeCopy(corrupt);
+    EXPECT_THROW(validate("../bin/validate-test-corrupt.fbx"), std::runtime_error);
+
+    // Invalid property code.
+    corrupt = data;
+    corrupt[27 + 13 + 5] = 'x';
+    writeCopy(corrupt);
+    EXPECT_THROW(validate("../bin/validate-test-corrupt.fbx"), std::runtime_error);
+
+    // Truncated file.
+    corrupt.assign(data.begin(), data.begin() + payloadOffset + 10);
+    writeCopy(corrupt);
+    EXPECT_THROW(validate("../bin/validate-test-corrupt.fbx"), std::runtime_error);
+}
+
+TEST(Record, ObjectIndex)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    ObjectIndex index(file);
+    EXPECT_EQ(index.size(), 7);
+
+    Record * pGeometry = index.find(879638976);
+    ASSERT_NE(pGeometry, nullptr);
+    EXPECT_STREQ(pGeometry->name().c_str(), "Geometry");
+
+    Record * pModel = index.find(606054263);
+    ASSERT_NE(pModel, nullptr);
+    EXPECT_STREQ(pModel->name().c_str(), "Model");
+
+    EXPECT_EQ(index.find(12345), nullptr);
+
+    index.clear();
+    EXPECT_EQ(index.find(879638976), nullptr);
+}
+
+TEST(Record, ConnectionGraph)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    ConnectionGraph graph(file);
+    EXPECT_EQ(graph.size(), 7);
+
+    auto rootChildren = graph.children(0);
+    EXPECT_EQ(rootChildren.size(), 3);
+    EXPECT_EQ(rootChildren[0].uid, 606054263);
+    EXPECT_EQ(rootChildren[0].type, ConnectionGraph::Type::ObjectObject);
+
+    auto cubeChildren = graph.children(606054263);
+    ASSERT_EQ(cubeChildren.size(), 2);
+    EXPECT_EQ(cubeChildren[0].uid, 879638976);
+
+    auto geometryParents = graph.parents(879638976);
+    ASSERT_EQ(geometryParents.size(), 1);
+    EXPECT_EQ(geometryParents[0].uid, 606054263);
+    EXPECT_TRUE(graph.children(879638976).empty());
+    EXPECT_FALSE(graph.contains(12345));
+
+    // Object to property connections carry the property name.
+    Record connections("Connections");
+    Record * pC = new Record("C", &connections);
+    pC->properties().insert(new Property("OP"));
+    pC->properties().insert(new Property((int64_t)10));
+    pC->properties().insert(new Property((int64_t)20));
+    pC->properties().insert(new Property("DiffuseColor"));
+    graph.build(connections);
+    ASSERT_EQ(graph.parents(10).size(), 1);
+    EXPECT_EQ(graph.parents(10)[0].type, ConnectionGraph::Type::ObjectProperty);
+    EXPECT_EQ(graph.label(graph.parents(10)[0].parentProperty), "DiffuseColor");
+    EXPECT_EQ(graph.label(graph.children(20)[0].childProperty), "");
+}
+
+TEST(Record, PropertyTable)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    ObjectIndex index(file);
+    const Record * pLamp = index.find(146471051);
+    ASSERT_NE(pLamp, nullptr);
+
+    const uint32_t translation = PropertyTable::intern("Lcl Translation");
+    const uint32_t inheritType = PropertyTable::intern("InheritType");
+    const uint32_t rotationOrder = PropertyTable::intern("RotationOrder");
+
+    PropertyTable table(*pLamp);
+    EXPECT_EQ(table.size(), 5);
+
+    double values[3];
+    ASSERT_TRUE(table.vector(translation, values));
+    EXPECT_NEAR(values[0], 407.624542, 1e-5);
+    EXPECT_NEAR(values[2], -100.545395, 1e-5);
+    EXPECT_EQ(table.integer(inheritType, -1), 1);
+    EXPECT_EQ(table.integer(rotationOrder, -1), -1);
+
+    const PropertyTable::Entry * pEntry = table.find("Lcl Translation");
+    ASSERT_NE(pEntry, nullptr);
+    EXPECT_EQ(pEntry->kind, PropertyTable::Kind::Vector);
+    EXPECT_EQ(std::string(pEntry->type.begin(), pEntry->type.end()), "Lcl Translation");
+    EXPECT_EQ(std::string(pEntry->flags.begin(), pEntry->flags.end()), "A");
+    EXPECT_EQ(table.find("Not a property"), nullptr);
+
+    // Fall back to the property template.
+    const Record * pTemplate = nullptr;
+    for (auto pDefinition : **file.find("Definitions"))
+    {
+        if (pDefinition->properties().size() && pDefinition->properties().front()->string() == "Model")
+        {
+            pTemplate = *pDefinition->find("PropertyTemplate");
+        }
+    }
+    ASSERT_NE(pTemplate, nullptr);
+    PropertyTable defaults(*pTemplate);
+    PropertyTable withDefaults(*pLamp, &defaults);
+    EXPECT_EQ(withDefaults.integer(rotationOrder, -1), 0);
+
+    // Threads interning overlapping names, enough to grow the pool, agree on every id while sharing one table.
+    const size_t names = 5000;
+    std::vector<std::vector<uint32_t>> ids(8, std::vector<uint32_t>(names));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ids.size(); t++)
+    {
+        threads.emplace_back([&ids, &withDefaults, rotationOrder, names, t]()
+        {
+            for (size_t i = 0; i < names; i++)
+            {
+                const size_t name = (i + t * 613) % names;
+                ids[t][name] = PropertyTable::intern("Threaded " + std::to_string(name));
+                EXPECT_EQ(withDefaults.integer(rotationOrder, -1), 0);
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    for (size_t t = 1; t < ids.size(); t++)
+    {
+        EXPECT_EQ(ids[t], ids[0]);
+    }
+    EXPECT_EQ(PropertyTable::intern("Threaded 42"), ids[0][42]);
+    EXPECT_NE(ids[0][42], ids[0][43]);
+}
+
+TEST(Record, Triangulate)
+{
+    // Concave pentagon, fan triangulation from corner 0 would give a degenerate triangle.
+    const double vertices[] = { 0, 0, 0, 2, 0, 0, 2, 2, 0, 1, 1, 0, 0, 2, 0 };
+    const int32_t polygon[] = { 0, 1, 2, 3, ~4 };
+    Triangulation concave = triangulate(Span<const int32_t>(polygon, 5), Span<const double>(vertices, 15));
+    ASSERT_EQ(concave.polygons.size(), 2);
+    ASSERT_EQ(concave.indices.size(), 9);
+    double area = 0.0;
+    for (size_t i = 0; i < concave.indices.size(); i += 3)
+    {
+        const double * a = &vertices[concave.indices[i] * 3];
+        const double * b = &vertices[concave.indices[i + 1] * 3];
+        const double * c = &vertices[concave.indices[i + 2] * 3];
+        const double triangleArea = ((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])) / 2.0;
+        EXPECT_GT(triangleArea, 0.0);
+        area += triangleArea;
+    }
+    EXPECT_NEAR(area, 3.0, 1e-9);
+
+    // Enough polygons to span several blocks, split across threads.
+    std::vector<int32_t> indices;
+    for (int32_t i = 0; i < 100000; i++)
+    {
+        const int32_t size = 3 + i % 3;
+        for (int32_t j = 0; j < size; j++)
+        {
+            indices.push_back(j + 1 == size ? ~j : j);
+        }
+    }
+    const Span<const int32_t> span(indices.data(), indices.size());
+    Triangulation serial = triangulate(span, Span<const double>(), 1);
+    Triangulation parallel = triangulate(span, Span<const double>(), 4);
+    EXPECT_EQ(serial.polygons.size(), 100001);
+    EXPECT_EQ(serial.indices.size(), (33334 * 1 + 33333 * 2 + 33333 * 3) * 3);
+    EXPECT_TRUE(serial.polygons == parallel.polygons);
+    EXPECT_TRUE(serial.indices == parallel.indices);
+
+    indices.back() = 0;
+    EXPECT_THROW(triangulate(Span<const int32_t>(indices.data(), indices.size())), std::runtime_error);
+}
+
+TEST(Record, DeferredArrays)
+{
+    Record eager;
+    Record deferred;
+    ReadOptions options;
+    options.deferArrays = true;
+    EXPECT_NO_THROW(eager.read("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(deferred.read("../models/blender-default.fbx", options));
+
+    const Property * pEager = (*(*(*(*eager.find("Objects"))->find("Geometry"))->find("LayerElementNormal"))->find("Normals"))->properties().front();
+    const Property * pDeferred = (*(*(*(*deferred.find("Objects"))->find("Geometry"))->find("LayerElementNormal"))->find("Normals"))->properties().front();
+    ASSERT_TRUE(pDeferred->isEncoded());
+    EXPECT_FALSE(pEager->isEncoded());
+    EXPECT_EQ(pDeferred->size(), 72);
+    EXPECT_EQ(pDeferred->data(), nullptr);
+    EXPECT_THROW(pDeferred->getArray<double>(), std::runtime_error);
+
+    // Streaming conversion matches converting the decoded array.
+    const Span<const double> normals = pEager->getArray<double>();
+    std::vector<float> converted(72);
+    float minimum[3];
+    float maximum[3];
+    EXPECT_EQ(pDeferred->convert(converted.data(), 3, minimum, maximum), 72);
+    for (size_t i = 0; i < 72; i++)
+    {
+        EXPECT_EQ(converted[i], static_cast<float>(normals[i]));
+    }
+    for (size_t c = 0; c < 3; c++)
+    {
+        EXPECT_EQ(minimum[c], -1.0f);
+        EXPECT_EQ(maximum[c], 1.0f);
+    }
+    std::vector<float> direct(72);
+    pEager->convert(direct.data(), 3);
+    EXPECT_TRUE(direct == converted);
+    EXPECT_THROW(pDeferred->convert(converted.data(), 5), std::runtime_error);
+
+    Property copy(*pDeferred);
+    copy.decode();
+    EXPECT_FALSE(copy.isEncoded());
+    EXPECT_TRUE(std::equal(normals.begin(), normals.end(), copy.getArray<double>().begin()));
+
+    // Encoded arrays are written back as they are and meshes decode them on demand.
+    EXPECT_NO_THROW(deferred.write("../bin/blender-deferred-test.fbx"));
+    Record reread;
+    EXPECT_NO_THROW(reread.read("../bin/blender-deferred-test.fbx"));
+    EXPECT_TRUE(recordsEqual(&eager, &reread));
+
+    const Record * pGeometry = *(*deferred.find("Objects"))->find("Geometry");
+    EXPECT_EQ(extractMesh(*pGeometry).indices.size(), 12 * 3);
+
+    // Arrays larger than a conversion chunk.
+    std::vector<double> values(30000);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = static_cast<double>(i % 3) * 10.0 - static_cast<double>(i / 3) * 0.5;
+    }
+    Record file;
+    (new Record("Values", &file))->properties().insert(new Property(values.data(), static_cast<uint32_t>(values.size())));
+    EXPECT_NO_THROW(file.write("../bin/deferred-values-test.fbx"));
+    Record large;
+    EXPECT_NO_THROW(large.read("../bin/deferred-values-test.fbx", options));
+    const Property * pValues = (*large.find("Values"))->properties().front();
+    ASSERT_TRUE(pValues->isEncoded());
+    std::vector<float> output(values.size());
+    EXPECT_EQ(pValues->convert(output.data(), 3, minimum, maximum), 30000);
+    EXPECT_EQ(output[29999], static_cast<float>(values[29999]));
+    EXPECT_EQ(minimum[1], static_cast<float>(10.0 - 9999 * 0.5));
+    EXPECT_EQ(maximum[2], 20.0f);
+}
+
+TEST(Record, Mesh)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    ObjectIndex index(file);
+    const Record * pCube = index.find(879638976);
+    ASSERT_NE(pCube, nullptr);
+
+    Mesh cube = extractMesh(*pCube);
+    EXPECT_EQ(cube.positions.size(), 24 * 3);
+    EXPECT_EQ(cube.normals.size(), 24 * 3);
+    EXPECT_EQ(cube.indices.size(), 12 * 3);
+    EXPECT_TRUE(cube.uvs.empty());
+    for (size_t i = 0; i < cube.normals.size(); i += 3)
+    {
+        const float length = cube.normals[i] * cube.normals[i] + cube.normals[i + 1] * cube.normals[i + 1] + cube.normals[i + 2] * cube.normals[i + 2];
+        EXPECT_NEAR(length, 1.0f, 1e-4f);
+    }
+
+    // A triangle and a quad with indexed per-vertex uvs and per-polygon colors.
+    Record geometry("Geometry");
+    const double vertices[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 2, 0, 0 };
+    const int32_t polygons[] = { 0, 1, ~4, 0, 1, 2, ~3 };
+    (new Record("Vertices", &geometry))->properties().insert(new Property(vertices, 15));
+    (new Record("PolygonVertexIndex", &geometry))->properties().insert(new Property(polygons, 7));
+
+    Record * pUV = new Record("LayerElementUV", &geometry);
+    const double uv[] = { 0, 0, 1, 1 };
+    const int32_t uvIndex[] = { 0, 1, 1, 0, 1 };
+    (new Record("MappingInformationType", pUV))->properties().insert(new Property("ByVertice"));
+    (new Record("ReferenceInformationType", pUV))->properties().insert(new Property("IndexToDirect"));
+    (new Record("UV", pUV))->properties().insert(new Property(uv, 4));
+    (new Record("UVIndex", pUV))->properties().insert(new Property(uvIndex, 5));
+
+    Record * pColor = new Record("LayerElementColor", &geometry);
+    const double colors[] = { 1, 0, 0, 1, 0, 1, 0, 1 };
+    (new Record("MappingInformationType", pColor))->properties().insert(new Property("ByPolygon"));
+    (new Record("ReferenceInformationType", pColor))->properties().insert(new Property("Direct"));
+    (new Record("Colors", pColor))->properties().insert(new Property(colors, 8));
+
+    Mesh mesh = extractMesh(geometry, 4);
+    const uint32_t indices[] = { 0, 1, 2, 3, 4, 5, 3, 5, 6 };
+    ASSERT_EQ(mesh.indices.size(), 9);
+    EXPECT_TRUE(std::equal(mesh.indices.begin(), mesh.indices.end(), indices));
+    EXPECT_EQ(mesh.positions[2 * 3], 2.0f);
+    EXPECT_EQ(mesh.uvs[2 * 2], 1.0f);
+    EXPECT_EQ(mesh.uvs[3 * 2], 0.0f);
+    EXPECT_EQ(mesh.colors[2 * 4], 1.0f);
+    EXPECT_EQ(mesh.colors[3 * 4 + 1], 1.0f);
+
+    (*geometry.find("PolygonVertexIndex"))->properties().front()->getArray<int32_t>()[1] = 9;
+    EXPECT_THROW(extractMesh(geometry), std::runtime_error);
+
+    // A strip of quads read within a memory budget smaller than its arrays.
+    Record strip;
+    Record * pStrip = new Record("Geometry", new Record("Objects", &strip));
+    const int32_t quads = 4000;
+    std::vector<double> stripVertices;
+    std::vector<int32_t> stripPolygons;
+    std::vector<double> stripNormals;
+    for (int32_t i = 0; i <= quads; i++)
+    {
+        stripVertices.insert(stripVertices.end(), { static_cast<double>(i), 0.0, 0.0, static_cast<double>(i), 1.0, 0.0 });
+    }
+    for (int32_t i = 0; i < quads; i++)
+    {
+        stripPolygons.insert(stripPolygons.end(), { 2 * i, 2 * i + 2, 2 * i + 3, ~(2 * i + 1) });
+        for (int corner = 0; corner < 4; corner++)
+        {
+            stripNormals.insert(stripNormals.end(), { 0.0, static_cast<double>(i % 2), 1.0 });
+        }
+    }
+    std::vector<int32_t> stripUVIndex(stripPolygons.size());
+    for (size_t i = 0; i < stripUVIndex.size(); i++)
+    {
+        stripUVIndex[i] = static_cast<int32_t>(i % 2);
+    }
+    (new Record("Vertices", pStrip))->properties().insert(new Property(stripVertices.data(), static_cast<uint32_t>(stripVertices.size())));
+    (new Record("PolygonVertexIndex", pStrip))->properties().insert(new Property(stripPolygons.data(), static_cast<uint32_t>(stripPolygons.size())));
+    Record * pStripNormals = new Record("LayerElementNormal", pStrip);
+    (new Record("Normals", pStripNormals))->properties().insert(new Property(stripNormals.data(), static_cast<uint32_t>(stripNormals.size())));
+    Record * pStripUV = new Record("LayerElementUV", pStrip);
+    (new Record("ReferenceInformationType", pStripUV))->properties().insert(new Property("IndexToDirect"));
+    (new Record("UV", pStripUV))->properties().insert(new Property(uv, 4));
+    (new Record("UVIndex", pStripUV))->properties().insert(new Property(stripUVIndex.data(), static_cast<uint32_t>(stripUVIndex.size())));
+    EXPECT_NO_THROW(strip.write("../bin/mesh-budget.fbx"));
+
+    ReadOptions options;
+    options.memoryBudget = 50000;
+    Record budgeted;
+    EXPECT_NO_THROW(budgeted.read("../bin/mesh-budget.fbx", options));
+    const Record & budgetedGeometry = **(*budgeted.find("Objects"))->find("Geometry");
+    EXPECT_TRUE((*budgetedGeometry.find("PolygonVertexIndex"))->properties().front()->isPaged());
+    const Mesh expected = extractMesh(*pStrip);
+    const Mesh paged = extractMesh(budgetedGeometry, 4);
+    EXPECT_EQ(paged.positions, expected.positions);
+    EXPECT_EQ(paged.normals, expected.normals);
+    EXPECT_EQ(paged.uvs, expected.uvs);
+    EXPECT_EQ(paged.indices, expected.indices);
+}
+
+TEST(Record, Skin)
+{
+    Record file;
+    Record * pObjects = new Record("Objects", &file);
+    Record * pConnections = new Record("Connections", &file);
+
+    auto addObject = [pObjects](const char * name, const int64_t uid, const char * type)
+    {
+        Record * pObject = new Record(name, pObjects);
+        pObject->properties().insert(new Property(uid));
+        pObject->properties().insert(new Property(std::string(name) + std::string("\x00\x01", 2) + name));
+        pObject->properties().insert(new Property(type));
+        return pObject;
+    };
+    auto connect = [pConnections](const int64_t child, const int64_t parent)
+    {
+        Record * pC = new Record("C", pConnections);
+        pC->properties().insert(new Property("OO"));
+        pC->properties().insert(new Property(child));
+        pC->properties().insert(new Property(parent));
+    };
+
+    const double vertices[] = { 0, 0, 0, 1, 0, 0, 2, 0, 0, 3, 0, 0 };
+    Record * pGeometry = addObject("Geometry", 1, "Mesh");
+    (new Record("Vertices", pGeometry))->properties().insert(new Property(vertices, 12));
+    Record * pSkin = addObject("Deformer", 2, "Skin");
+    connect(2, 1);
+
+    // Three bones; vertex 1 is influenced by all of them.
+    const int32_t indexes[3][2] = { { 0, 1 }, { 1, 2 }, { 1, 3 } };
+    const double weights[3][2] = { { 1.0, 0.5 }, { 0.3, 1.0 }, { 0.2, 0.0 } };
+    for (int64_t i = 0; i < 3; i++)
+    {
+        Record * pCluster = addObject("Deformer", 10 + i, "Cluster");
+        (new Record("Indexes", pCluster))->properties().insert(new Property(indexes[i], 2));
+        (new Record("Weights", pCluster))->properties().insert(new Property(weights[i], 2));
+        addObject("Model", 20 + i, "LimbNode");
+        connect(10 + i, 2);
+        connect(20 + i, 10 + i);
+    }
+
+    ObjectIndex objects(file);
+    ConnectionGraph connections(file);
+    SkinWeights skin = extractSkin(*pSkin, objects, connections, 2);
+    EXPECT_EQ(skin.influences, 2);
+    ASSERT_EQ(skin.bones.size(), 3);
+    EXPECT_EQ(skin.bones[2], 22);
+    ASSERT_EQ(skin.joints.size(), 8);
+
+    EXPECT_EQ(skin.joints[0], 0);
+    EXPECT_FLOAT_EQ(skin.weights[0], 1.0f);
+    EXPECT_FLOAT_EQ(skin.weights[1], 0.0f);
+
+    // Strongest two of 0.5, 0.3 and 0.2, renormalized.
+    EXPECT_EQ(skin.joints[2], 0);
+    EXPECT_EQ(skin.joints[3], 1);
+    EXPECT_FLOAT_EQ(skin.weights[2], 0.5f / 0.8f);
+    EXPECT_FLOAT_EQ(skin.weights[3], 0.3f / 0.8f);
+
+    EXPECT_EQ(skin.joints[4], 1);
+    EXPECT_FLOAT_EQ(skin.weights[4], 1.0f);
+    EXPECT_FLOAT_EQ(skin.weights[6], 0.0f);
+
+    SkinWeights threaded = extractSkin(*pSkin, objects, connections, 2, 3);
+    EXPECT_TRUE(threaded.joints == skin.joints);
+    EXPECT_TRUE(threaded.weights == skin.weights);
+
+    (*objects.find(12)->find("Indexes"))->properties().front()->getArray<int32_t>()[0] = 7;
+    EXPECT_THROW(extractSkin(*pSkin, objects, connections), std::runtime_error);
+}
+
+TEST(Record, Animation)
+{
+    Record file;
+    Record * pObjects = new Record("Objects", &file);
+    Record * pConnections = new Record("Connections", &file);
+
+    auto addObject = [pObjects](const char * name, const int64_t uid)
+    {
+        Record * pObject = new Record(name, pObjects);
+        pObject->properties().insert(new Property(uid));
+        pObject->properties().insert(new Property(name));
+        pObject->properties().insert(new Property(""));
+        return pObject;
+    };
+    auto connect = [pConnections](const char * type, const int64_t child, const int64_t parent, const char * property)
+    {
+        Record * pC = new Record("C", pConnections);
+        pC->properties().insert(new Property(type));
+        pC->properties().insert(new Property(child));
+        pC->properties().insert(new Property(parent));
+        if (property != nullptr)
+        {
+            pC->properties().insert(new Property(property));
+        }
+    };
+
+    const int64_t second = AnimationCurve::ticksPerSecond;
+    Record * pStack = addObject("AnimationStack", 1);
+    Record * pProperties = new Record("Properties70", pStack);
+    const char * names[] = { "LocalStart", "LocalStop" };
+    for (int i = 0; i < 2; i++)
+    {
+        Record * pP = new Record("P", pProperties);
+        pP->properties().insert(new Property(names[i]));
+        pP->properties().insert(new Property("KTime"));
+        pP->properties().insert(new Property("Time"));
+        pP->properties().insert(new Property(""));
+        pP->properties().insert(new Property(i * 3 * second));
+    }
+    addObject("AnimationLayer", 2);
+    addObject("AnimationCurveNode", 4);
+    addObject("Model", 5);
+
+    // Linear from 0 to 10, held at 10, then a flat tangent cubic from 20 down to 0.
+    Record * pCurve = addObject("AnimationCurve", 3);
+    const int64_t times[] = { 0, second, 2 * second, 3 * second };
+    const float values[] = { 0.0f, 10.0f, 20.0f, 0.0f };
+    const int32_t flags[] = { 0x00000004, 0x00000002, 0x00000008 };
+    const float data[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    const int32_t refCounts[] = { 1, 1, 2 };
+    (new Record("KeyTime", pCurve))->properties().insert(new Property(times, 4));
+    (new Record("KeyValueFloat", pCurve))->properties().insert(new Property(values, 4));
+    (new Record("KeyAttrFlags", pCurve))->properties().insert(new Property(flags, 3));
+    (new Record("KeyAttrDataFloat", pCurve))->properties().insert(new Property(data, 12));
+    (new Record("KeyAttrRefCount", pCurve))->properties().insert(new Property(refCounts, 3));
+
+    connect("OO", 2, 1, nullptr);
+    connect("OO", 4, 2, nullptr);
+    connect("OP", 4, 5, "Lcl Translation");
+    connect("OP", 3, 4, "d|Y");
+
+    AnimationCurve curve(*pCurve);
+    ASSERT_EQ(curve.size(), 4);
+    EXPECT_EQ(curve.interpolations()[1], AnimationCurve::Interpolation::Constant);
+    EXPECT_EQ(curve.interpolations()[3], AnimationCurve::Interpolation::Cubic);
+    EXPECT_FLOAT_EQ(curve.evaluate(-second), 0.0f);
+    EXPECT_FLOAT_EQ(curve.evaluate(second / 2), 5.0f);
+    EXPECT_FLOAT_EQ(curve.evaluate(second + second / 2), 10.0f);
+    EXPECT_FLOAT_EQ(curve.evaluate(2 * second + second / 2), 10.0f);
+    EXPECT_FLOAT_EQ(curve.evaluate(5 * second), 0.0f);
+
+    ObjectIndex objects(file);
+    ConnectionGraph connections(file);
+    BakedAnimation baked = bakeAnimation(*pStack, objects, connections, 2.0, 2);
+    EXPECT_EQ(baked.start, 0);
+    EXPECT_EQ(baked.step, second / 2);
+    ASSERT_EQ(baked.frames, 7);
+    ASSERT_EQ(baked.channels.size(), 1);
+    EXPECT_EQ(baked.channels[0].node, 5);
+    EXPECT_EQ(baked.channels[0].property, "Lcl Translation");
+    EXPECT_EQ(baked.channels[0].component, 1);
+    const float expected[] = { 0.0f, 5.0f, 10.0f, 10.0f, 20.0f, 10.0f, 0.0f };
+    for (size_t i = 0; i < 7; i++)
+    {
+        EXPECT_FLOAT_EQ(baked.samples[i], expected[i]);
+    }
+}
+
+TEST(Record, Transforms)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    ConnectionGraph connections(file);
+    SceneTransforms scene = evaluateTransforms(file, connections);
+    ASSERT_EQ(scene.nodes.size(), 3);
+    ASSERT_EQ(scene.world.size(), 3 * 16);
+
+    // The cube is rotated -90 degrees around x and scaled by 100.
+    const size_t cube = std::find(scene.nodes.begin(), scene.nodes.end(), 606054263) - scene.nodes.begin();
+    ASSERT_LT(cube, scene.nodes.size());
+    EXPECT_EQ(scene.parents[cube], -1);
+    const double * pCube = &scene.world[cube * 16];
+    EXPECT_NEAR(pCube[0], 100.0, 1e-3);
+    EXPECT_NEAR(pCube[6], -100.0, 1e-3);
+    EXPECT_NEAR(pCube[9], 100.0, 1e-3);
+    EXPECT_NEAR(pCube[5], 0.0, 1e-3);
+
+    const size_t lamp = std::find(scene.nodes.begin(), scene.nodes.end(), 146471051) - scene.nodes.begin();
+    EXPECT_NEAR(scene.world[lamp * 16 + 12], 407.624542, 1e-5);
+    EXPECT_NEAR(scene.world[lamp * 16 + 14], -100.545395, 1e-5);
+
+    // A chain of translated children, rotated at the root.
+    Record chain;
+    Record * pObjects = new Record("Objects", &chain);
+    Record * pConnections = new Record("Connections", &chain);
+    for (int64_t i = 1; i <= 4; i++)
+    {
+        Record * pModel = new Record("Model", pObjects);
+        pModel->properties().insert(new Property(i));
+        pModel->properties().insert(new Property("Model"));
+        pModel->properties().insert(new Property("Null"));
+        Record * pP = new Record("P", new Record("Properties70", pModel));
+        pP->properties().insert(new Property(i == 1 ? "Lcl Rotation" : "Lcl Translation"));
+        pP->properties().insert(new Property(""));
+        pP->properties().insert(new Property(""));
+        pP->properties().insert(new Property("A"));
+        pP->properties().insert(new Property(0.0));
+        pP->properties().insert(new Property(i == 1 ? 0.0 : 1.0));
+        pP->properties().insert(new Property(i == 1 ? 90.0 : 0.0));
+
+        Record * pC = new Record("C", pConnections);
+        pC->properties().insert(new Property("OO"));
+        pC->properties().insert(new Property(i));
+        pC->properties().insert(new Property(i - 1));
+    }
+    connections.build(chain);
+    SceneTransforms transforms = evaluateTransforms(chain, connections, 4);
+    ASSERT_EQ(transforms.nodes.size(), 4);
+    EXPECT_EQ(transforms.parents[3], 2);
+    EXPECT_NEAR(transforms.world[3 * 16 + 12], -3.0, 1e-9);
+    EXPECT_NEAR(transforms.world[3 * 16 + 13], 0.0, 1e-9);
+    EXPECT_NEAR(transforms.local[3 * 16 + 13], 1.0, 1e-9);
+
+    Record * pLoop = new Record("C", pConnections);
+    pLoop->properties().insert(new Property("OO"));
+    pLoop->properties().insert(new Property((int64_t)1));
+    pLoop->properties().insert(new Property((int64_t)4));
+    pConnections->erase(pConnections->begin());
+    pConnections->insert(pConnections->begin(), pLoop);
+    connections.build(chain);
+    EXPECT_THROW(evaluateTransforms(chain, connections), std::runtime_error);
+
+    // Several chunks of models on many threads, all translated by the shared property template.
+    Record templated;
+    Record * pType = new Record("ObjectType", new Record("Definitions", &templated));
+    pType->properties().insert(new Property("Model"));
+    Record * pTemplateP = new Record("P", new Record("Properties70", new Record("PropertyTemplate", pType)));
+    pTemplateP->properties().insert(new Property("Lcl Translation"));
+    pTemplateP->properties().insert(new Property(""));
+    pTemplateP->properties().insert(new Property(""));
+    pTemplateP->properties().insert(new Property("A"));
+    pTemplateP->properties().insert(new Property(0.0));
+    pTemplateP->properties().insert(new Property(2.0));
+    pTemplateP->properties().insert(new Property(0.0));
+    Record * pModels = new Record("Objects", &templated);
+    for (int64_t i = 1; i <= 5000; i++)
+    {
+        Record * pModel = new Record("Model", pModels);
+        pModel->properties().insert(new Property(i));
+        pModel->properties().insert(new Property("Model"));
+        pModel->properties().insert(new Property("Null"));
+        new Record("Properties70", pModel);
+    }
+    connections.build(templated);
+    SceneTransforms threaded = evaluateTransforms(templated, connections, 8);
+    ASSERT_EQ(threaded.nodes.size(), 5000U);
+    for (size_t i = 0; i < threaded.nodes.size(); i++)
+    {
+        EXPECT_EQ(threaded.local[i * 16 + 13], 2.0);
+    }
+}
+
+TEST(Record, EmbeddedMedia)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+    Record * pObjects = *file.find("Objects");
+
+    std::vector<uint8_t> content(300 * 1024);
+    for (size_t i = 0; i < content.size(); i++)
+    {
+        content[i] = static_cast<uint8_t>(i * 31 + i / 7);
+    }
+
+    Record * pVideo = new Record("Video", pObjects);
+    pVideo->properties().insert(new Property((int64_t)42));
+    pVideo->properties().insert(new Property(std::string("Texture") + std::string("\x00\x01", 2) + "Video"));
+    pVideo->properties().insert(new Property("Clip"));
+    (new Record("Filename", pVideo))->properties().insert(new Property("C:/textures/texture.png"));
+    (new Record("RelativeFilename", pVideo))->properties().insert(new Property("textures/texture.png"));
+    (new Record("Content", pVideo))->properties().insert(new Property(content.data(), static_cast<uint32_t>(content.size())));
+
+    // Videos without embedded content are not listed.
+    Record * pReference = new Record("Video", pObjects);
+    pReference->properties().insert(new Property((int64_t)43));
+    (new Record("Content", pReference))->properties().insert(new Property(static_cast<const uint8_t *>(nullptr), 0));
+    EXPECT_NO_THROW(file.write("../bin/embedded-media-test.fbx"));
+
+    std::vector<EmbeddedMedia> media = listEmbeddedMedia("../bin/embedded-media-test.fbx");
+    ASSERT_EQ(media.size(), 1);
+    EXPECT_EQ(media[0].uid, 42);
+    EXPECT_EQ(media[0].name, "Texture");
+    EXPECT_EQ(media[0].filename, "textures/texture.png");
+    EXPECT_EQ(media[0].size, content.size());
+
+    FILE * pOutput = tmpfile();
+    ASSERT_NE(pOutput, nullptr);
+    EXPECT_NO_THROW(extractEmbeddedMedia("../bin/embedded-media-test.fbx", media[0], fileno(pOutput)));
+    std::vector<uint8_t> extracted(content.size() + 1);
+    rewind(pOutput);
+    EXPECT_EQ(fread(extracted.data(), 1, extracted.size(), pOutput), content.size());
+    extracted.pop_back();
+    EXPECT_TRUE(extracted == content);
+    fclose(pOutput);
+
+    EXPECT_TRUE(listEmbeddedMedia("../models/blender-default.fbx").empty());
+}
+
+TEST(Record, Zip)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+
+    std::remove("../bin/zip-test.zip");
+    EXPECT_NO_THROW(file.writeZip("../bin/zip-test.zip", "models/first.fbx"));
+    EXPECT_NO_THROW(file.writeZip("../bin/zip-test.zip", "models/second.fbx", 7400));
+    EXPECT_THROW(file.writeZip("../bin/zip-test.zip", "models/first.fbx"), std::runtime_error);
+
+    Record first;
+    Record second;
+    EXPECT_NO_THROW(first.readZip("../bin/zip-test.zip", "models/first.fbx"));
+    EXPECT_TRUE(recordsEqual(&file, &first));
+
+    ReadOptions options;
+    uint32_t version = 0;
+    options.onHeaderRead = [&version](std::string, uint32_t headerVersion) { version = headerVersion; };
+    EXPECT_NO_THROW(second.readZip("../bin/zip-test.zip", "models/second.fbx", options));
+    EXPECT_EQ(version, 7400);
+    EXPECT_TRUE(recordsEqual(&file, &second));
+
+    Record missing;
+    EXPECT_THROW(missing.readZip("../bin/zip-test.zip", "models/third.fbx"), std::runtime_error);
+    EXPECT_THROW(missing.readZip("../bin/no-such-archive.zip", "models/first.fbx"), std::runtime_error);
+
+    // Entries spanning many inflate chunks.
+    std::vector<int64_t> noise(100000);
+    uint64_t state = 1;
+    for (auto & value : noise)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        value = static_cast<int64_t>(state >> 1);
+    }
+    Record large;
+    (new Record("Noise", &large))->properties().insert(new Property(noise.data(), static_cast<uint32_t>(noise.size())));
+    (new Record("After", &large))->properties().insert(new Property("tail"));
+    EXPECT_NO_THROW(large.writeZip("../bin/zip-test.zip", "large.fbx"));
+    Record largeRead;
+    EXPECT_NO_THROW(largeRead.readZip("../bin/zip-test.zip", "large.fbx"));
+    EXPECT_TRUE(recordsEqual(&large, &largeRead));
+
+    // Any seekable stream works as a source.
+    std::ifstream stream("../models/blender-default.fbx", std::ios::binary);
+    Record streamed;
+    EXPECT_NO_THROW(streamed.read(stream, ReadOptions()));
+    EXPECT_TRUE(recordsEqual(&file, &streamed));
+}
+
+TEST(Record, ZipCorrupt)
+{
+    Record file;
+    for (int i = 0; i < 4; i++)
+    {
+        Record * pRecord = new Record("Model", &file);
+        pRecord->properties().insert(new Property(static_cast<int64_t>(i)));
+        pRecord->properties().insert(new Property("Model" + std::to_string(i)));
+        (new Record("Child", pRecord))->properties().insert(new Property(static_cast<double>(i)));
+    }
+    std::remove("../bin/zip-corrupt.zip");
+    EXPECT_NO_THROW(file.writeZip("../bin/zip-corrupt.zip", "scene.fbx"));
+    std::ifstream source("../bin/zip-corrupt.zip", std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    ASSERT_GT(bytes.size(), 0U);
+
+    // Every flipped byte either fails the read or leaves the tree intact, never a silently partial tree.
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        std::string corrupt = bytes;
+        corrupt[i] = static_cast<char>(corrupt[i] ^ 0x5A);
+        std::ofstream("../bin/zip-corrupt-copy.zip", std::ios::binary) << corrupt;
+
+        Record read;
+        bool failed = false;
+        try
+        {
+            read.readZip("../bin/zip-corrupt-copy.zip", "scene.fbx");
+        }
+        catch (const std::runtime_error &)
+        {
+            failed = true;
+        }
+        EXPECT_TRUE(failed || recordsEqual(&file, &read)) << "byte " << i;
+    }
+}
+
+TEST(Record, Statistics)
+{
+    Statistics readStatistics;
+    std::map<std::string, double> exported;
+    ReadOptions readOptions;
+    readOptions.statistics = &readStatistics;
+    readOptions.onStatistics = [&exported](const Statistics & statistics)
+    {
+        statistics.forEach([&exported](const std::string & name, double value) { exported[name] = value; });
+    };
+
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx", readOptions));
+
+    size_t records = 0;
+    size_t properties = 0;
+    std::vector<const Record *> pending(file.begin(), file.end());
+    while (pending.size())
+    {
+        const Record * pRecord = pending.back();
+        pending.pop_back();
+        ++records;
+        properties += pRecord->properties().size();
+        pending.insert(pending.end(), pRecord->begin(), pRecord->end());
+    }
+
+    EXPECT_EQ(readStatistics.records, records);
+    EXPECT_EQ(readStatistics.properties, properties);
+    EXPECT_GT(readStatistics.bytesRead, 0U);
+    EXPECT_LE(readStatistics.bytesRead, 26028U);
+    EXPECT_GT(readStatistics.compressedBytes, 0U);
+    EXPECT_GT(readStatistics.decompressedBytes, readStatistics.compressedBytes);
+    EXPECT_GE(readStatistics.allocations, records + properties);
+    EXPECT_GE(readStatistics.totalSeconds, readStatistics.ioSeconds + readStatistics.inflateSeconds);
+    EXPECT_EQ(readStatistics.bytesWritten, 0U);
+    EXPECT_EQ(exported.size(), 13U);
+    EXPECT_EQ(exported["records"], static_cast<double>(records));
+
+    Statistics writeStatistics;
+    WriteOptions writeOptions;
+    writeOptions.statistics = &writeStatistics;
+    EXPECT_NO_THROW(file.write("../bin/statistics-test.fbx", writeOptions));
+    std::ifstream written("../bin/statistics-test.fbx", std::ios::binary | std::ios::ate);
+    EXPECT_EQ(writeStatistics.bytesWritten, static_cast<uint64_t>(written.tellg()));
+    EXPECT_EQ(writeStatistics.records, records);
+    EXPECT_EQ(writeStatistics.properties, properties);
+    EXPECT_GT(writeStatistics.decompressedBytes, writeStatistics.compressedBytes);
+    EXPECT_EQ(writeStatistics.bytesRead, 0U);
+
+    // Deferred arrays are counted as compressed bytes only.
+    readOptions.deferArrays = true;
+    readOptions.onStatistics = nullptr;
+    Record deferred;
+    EXPECT_NO_THROW(deferred.read("../models/blender-default.fbx", readOptions));
+    EXPECT_GT(readStatistics.compressedBytes, 0U);
+    EXPECT_EQ(readStatistics.decompressedBytes, 0U);
+    EXPECT_EQ(readStatistics.inflateSeconds, 0.0);
+}
+
+TEST(Record, Progress)
+{
+    std::vector<std::pair<uint64_t, uint64_t>> reports;
+    ReadOptions readOptions;
+    readOptions.progressInterval = 1;
+    readOptions.onProgress = [&reports](uint64_t processed, uint64_t total)
+    {
+        reports.push_back(std::make_pair(processed, total));
+        return true;
+    };
+
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx", readOptions));
+    ASSERT_GT(reports.size(), 10U);
+    EXPECT_EQ(reports.back(), std::make_pair(uint64_t(26028), uint64_t(26028)));
+    for (size_t i = 1; i < reports.size(); i++)
+    {
+        EXPECT_LT(reports[i - 1].first, reports[i].first);
+    }
+
+    // A coarse interval bounds the number of callbacks.
+    const size_t fineReports = reports.size();
+    reports.clear();
+    readOptions.progressInterval = 10000;
+    Record coarse;
+    EXPECT_NO_THROW(coarse.read("../models/blender-default.fbx", readOptions));
+    EXPECT_LE(reports.size(), 4U);
+    EXPECT_LT(reports.size(), fineReports);
+
+    // Canceling frees the records read so far and keeps the existing ones.
+    size_t calls = 0;
+    readOptions.progressInterval = 1;
+    readOptions.onProgress = [&calls](uint64_t, uint64_t) { return ++calls < 5; };
+    Record canceled;
+    new Record("Existing", &canceled);
+    EXPECT_THROW(canceled.read("../models/blender-default.fbx", readOptions), OperationCanceled);
+    EXPECT_EQ(calls, 5U);
+    ASSERT_EQ(canceled.size(), 1U);
+    EXPECT_EQ((*canceled.begin())->name(), "Existing");
+
+    // Failed reads unwind the same way.
+    std::ifstream source("../models/blender-default.fbx", std::ios::binary);
+    std::string truncated((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    truncated.resize(truncated.size() / 2);
+    std::ofstream("../bin/progress-truncated.fbx", std::ios::binary) << truncated;
+    Record broken;
+    EXPECT_THROW(broken.read("../bin/progress-truncated.fbx"), std::runtime_error);
+    EXPECT_EQ(broken.size(), 0U);
+
+    // Writes report serialized bytes and leave the file untouched when canceled.
+    reports.clear();
+    WriteOptions writeOptions;
+    writeOptions.progressInterval = 1;
+    writeOptions.onProgress = [&reports](uint64_t processed, uint64_t total)
+    {
+        reports.push_back(std::make_pair(processed, total));
+        return true;
+    };
+    EXPECT_NO_THROW(file.write("../bin/progress-test.fbx", writeOptions));
+    ASSERT_GT(reports.size(), 10U);
+    EXPECT_EQ(reports.back().first, reports.back().second);
+    for (size_t i = 1; i < reports.size(); i++)
+    {
+        EXPECT_LT(reports[i - 1].first, reports[i].first);
+        EXPECT_LE(reports[i].first, reports[i].second);
+    }
+
+    writeOptions.onProgress = [](uint64_t processed, uint64_t) { return processed < 1000; };
+    EXPECT_THROW(coarse.write("../bin/progress-test.fbx", writeOptions), OperationCanceled);
+    Record reread;
+    EXPECT_NO_THROW(reread.read("../bin/progress-test.fbx"));
+    EXPECT_TRUE(recordsEqual(&file, &reread));
+}
+
+TEST(Record, MemoryUsage)
+{
+    Record empty;
+    EXPECT_EQ(empty.memoryUsage(), sizeof(Record));
+
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+    const size_t usage = file.memoryUsage();
+    EXPECT_GT(usage, 26028U);
+    EXPECT_EQ(file.memoryUsage(), usage);
+
+    Record reread;
+    EXPECT_NO_THROW(reread.read("../models/blender-default.fbx"));
+    EXPECT_EQ(reread.memoryUsage(), usage);
+
+    // Changes deep in the tree reach the root.
+    Record * pObjects = *file.find("Objects");
+    Record * pGeometry = *pObjects->find("Geometry");
+    const size_t objectsUsage = pObjects->memoryUsage();
+    std::vector<double> values(1000, 1.0);
+    Record * pAdded = new Record("Added", pGeometry);
+    pAdded->properties().insert(new Property(values.data(), static_cast<uint32_t>(values.size())));
+    EXPECT_GE(file.memoryUsage(), usage + values.size() * sizeof(double));
+    EXPECT_EQ(file.memoryUsage() - usage, pObjects->memoryUsage() - objectsUsage);
+    EXPECT_EQ(pAdded->memoryUsage(), sizeof(Record) + pAdded->properties().front()->memoryUsage() + sizeof(Property *) + 2 * sizeof(void *));
+
+    pAdded->name(std::string(100, 'x'));
+    EXPECT_GT(file.memoryUsage(), usage + values.size() * sizeof(double) + 100);
+
+    pGeometry->erase(pAdded);
+    EXPECT_EQ(file.memoryUsage(), usage);
+
+    // Moving a subtree keeps the total.
+    pGeometry->parent(&empty);
+    EXPECT_EQ(file.memoryUsage() + empty.memoryUsage(), usage + sizeof(Record));
+    file.insert(pGeometry);
+    EXPECT_EQ(file.memoryUsage(), usage);
+    EXPECT_EQ(empty.memoryUsage(), sizeof(Record));
+
+    file.clear();
+    EXPECT_EQ(file.memoryUsage(), sizeof(Record));
+}
+
+TEST(Record, MemoryBudget)
+{
+    class PeakResource : public MemoryResource
+    {
+
+    public:
+
+        PeakResource() :
+            bytes(0),
+            peak(0)
+        {}
+
+        void * allocate(const size_t size, const size_t) override
+        {
+            bytes += size;
+            peak = std::max(peak, bytes);
+            return ::operator new(size);
+        }
+
+        void deallocate(void * pointer, const size_t size, const size_t) override
+        {
+            bytes -= size;
+            ::operator delete(pointer);
+        }
+
+        size_t bytes;
+        size_t peak;
+
+    };
+
+    // Eight arrays of 80 KB, alternating between compressible and incompressible values.
+    Record source;
+    uint64_t state = 7;
+    for (int i = 0; i < 8; i++)
+    {
+        std::vector<double> values(10000);
+        for (size_t j = 0; j < values.size(); j++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            values[j] = i % 2 ? static_cast<double>(state >> 11) : static_cast<double>(j % 7);
+        }
+        Record * pArray = new Record("Array", &source);
+        pArray->properties().insert(new Property(values.data(), static_cast<uint32_t>(values.size())));
+        pArray->properties().insert(new Property(static_cast<int32_t>(i)));
+    }
+    (new Record("Small", &source))->properties().insert(new Property(std::vector<double>(10, 1.0).data(), 10));
+    EXPECT_NO_THROW(source.write("../bin/budget-test.fbx"));
+
+    PeakResource resource;
+    {
+        ReadOptions options;
+        options.memoryBudget = 200000;
+        Record file(&resource);
+        EXPECT_NO_THROW(file.read("../bin/budget-test.fbx", options));
+        EXPECT_LT(resource.peak, 100000U);
+        EXPECT_LT(file.memoryUsage(), 100000U);
+
+        const Record & constFile = file;
+        const Property * pFirst = constFile.front()->properties().front();
+        EXPECT_TRUE(pFirst->isPaged());
+        EXPECT_FALSE(constFile.back()->properties().front()->isPaged());
+
+        // Two passes over all arrays through leases stay within the budget plus the array being loaded.
+        for (int pass = 0; pass < 2; pass++)
+        {
+            auto sourceIt = source.begin();
+            for (const Record * pRecord : constFile)
+            {
+                const Property * pExpected = (*sourceIt++)->properties().front();
+                const Property::Lease lease = pRecord->properties().front()->lease();
+                ASSERT_EQ(lease.getArray<double>().size(), pExpected->size());
+                EXPECT_EQ(memcmp(lease.getArray<double>().data(), pExpected->getArray<double>().data(), pExpected->size() * sizeof(double)), 0);
+                EXPECT_LT(resource.bytes, 200000U + 80000U + 100000U);
+            }
+        }
+
+        // Leased arrays stay resident while the others are paged through.
+        {
+            const Property::Lease first = (*constFile.begin())->properties().front()->lease();
+            const Property::Lease second = (*++constFile.begin())->properties().front()->lease();
+            for (const Record * pRecord : constFile)
+            {
+                const Property::Lease lease = pRecord->properties().front()->lease();
+                EXPECT_EQ(memcmp(first.getArray<double>().data(), source.front()->properties().front()->getArray<double>().data(), 80000), 0);
+                EXPECT_EQ(memcmp(second.getArray<double>().data(), (*++source.begin())->properties().front()->getArray<double>().data(), 80000), 0);
+            }
+            EXPECT_LT(resource.bytes, 200000U + 3 * 80000U + 100000U);
+        }
+
+        // Concurrent conversions page arrays in and out of the shared pager.
+        {
+            std::vector<std::vector<float>> converted(8, std::vector<float>(10000));
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < converted.size(); i++)
+            {
+                threads.emplace_back([&constFile, &converted, i]()
+                {
+                    auto it = constFile.begin();
+                    std::advance(it, i);
+                    for (int pass = 0; pass < 4; pass++)
+                    {
+                        (*it)->properties().front()->convert(converted[i].data());
+                    }
+                });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+            auto sourceIt = source.begin();
+            for (auto & values : converted)
+            {
+                const Span<const double> expected = (*sourceIt++)->properties().front()->getArray<double>();
+                for (size_t i = 0; i < values.size(); i++)
+                {
+                    ASSERT_EQ(values[i], static_cast<float>(expected[i]));
+                }
+            }
+            EXPECT_LT(resource.bytes, 200000U + 80000U + 100000U);
+        }
+
+        // Walking all arrays through the const accessors stays within the budget, their views pin only while alive.
+        for (int pass = 0; pass < 2; pass++)
+        {
+            auto sourceIt = source.begin();
+            for (const Record * pRecord : constFile)
+            {
+                const Property * pExpected = (*sourceIt++)->properties().front();
+                const Property::ValueArray values = pRecord->properties().front()->array();
+                ASSERT_EQ(values.size(), pExpected->size());
+                EXPECT_EQ(reinterpret_cast<const double *>(values.data())[values.size() - 1], pExpected->getArray<double>()[pExpected->size() - 1]);
+                EXPECT_EQ(pRecord->properties().front()->getArray<double>()[1], pExpected->getArray<double>()[1]);
+                EXPECT_LT(resource.bytes, 200000U + 80000U + 100000U);
+            }
+        }
+        EXPECT_LT(resource.bytes, 200000U + 100000U);
+
+        // Spans from the const accessors keep their array resident while they live.
+        const Span<const double> firstSpan = (*constFile.begin())->properties().front()->getArray<double>();
+        const Span<const double> secondSpan = (*++constFile.begin())->properties().front()->getArray<double>();
+        for (const Record * pRecord : constFile)
+        {
+            pRecord->properties().front()->lease();
+        }
+        EXPECT_EQ(memcmp(firstSpan.data(), source.front()->properties().front()->getArray<double>().data(), 80000), 0);
+        EXPECT_EQ(memcmp(secondSpan.data(), (*++source.begin())->properties().front()->getArray<double>().data(), 80000), 0);
+        EXPECT_TRUE(recordsEqual(&source, &file));
+
+        // Copies and writable access take the array out of the pager.
+        Property copy(*pFirst);
+        EXPECT_FALSE(copy.isPaged());
+        EXPECT_EQ(copy.getArray<double>()[3], 3.0);
+
+        Property * pWritable = file.front()->properties().front();
+        pWritable->getArray<double>()[0] = -1.0;
+        EXPECT_FALSE(pWritable->isPaged());
+        EXPECT_EQ(pFirst->getArray<double>()[0], -1.0);
+        EXPECT_EQ(firstSpan[0], 0.0);
+
+        Property moved(std::move(*(*--(--file.end()))->properties().front()));
+        EXPECT_TRUE(moved.isPaged());
+        EXPECT_EQ(moved.size(), 10000U);
+
+        // Paged trees can be written back.
+        EXPECT_NO_THROW(file.write("../bin/budget-test-copy.fbx"));
+    }
+    EXPECT_EQ(resource.bytes, 0U);
+
+    Record rewritten;
+    EXPECT_NO_THROW(rewritten.read("../bin/budget-test-copy.fbx"));
+    EXPECT_EQ(rewritten.front()->properties().front()->getArray<double>()[0], -1.0);
+
+    ReadOptions options;
+    options.memoryBudget = 1;
+    std::ifstream stream("../bin/budget-test.fbx", std::ios::binary);
+    Record streamed;
+    EXPECT_THROW(streamed.read(stream, options), std::runtime_error);
+}
+
+bool viewEqual(const Record * record, const RecordView & view)
+{
+    if (std::string(record->name().c_str()) != view.name() || record->size() != view.size() ||
+        record->properties().size() != view.properties().size())
+    {
+        return false;
+    }
+
+    auto viewProperty = view.properties().begin();
+    for (const Property * pProperty : record->properties())
+    {
+        const PropertyView property = *viewProperty++;
+        if (pProperty->type() != property.type() || pProperty->size() != property.size() || pProperty->string() != property.string())
+        {
+            return false;
+        }
+        if (pProperty->isPrimitive() && memcmp(&pProperty->primitive(), property.data(), pProperty->size()) != 0)
+        {
+            return false;
+        }
+        if (pProperty->isArray())
+        {
+            const Property::ValueArray values = property.array();
+            if (reinterpret_cast<uintptr_t>(values.data()) % 64 != 0)
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < values.size(); i++)
+            {
+                const Property::Value expected = pProperty->array()[i];
+                const Property::Value value = values[i];
+                if (memcmp(&expected, &value, sizeof(Property::Value)) != 0)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    auto child = view.begin();
+    for (const Record * pChild : *record)
+    {
+        const RecordView childView = *child++;
+        if (childView.parent().name() != std::string(view.name()) || viewEqual(pChild, childView) == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(Record, Snapshot)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(file.writeSnapshot("../bin/blender-default.snapshot"));
+
+    Snapshot snapshot;
+    EXPECT_FALSE(snapshot.isOpen());
+    EXPECT_THROW(snapshot.root(), std::runtime_error);
+    EXPECT_NO_THROW(snapshot.open("../bin/blender-default.snapshot"));
+    ASSERT_TRUE(snapshot.isOpen());
+
+    const RecordView root = snapshot.root();
+    EXPECT_FALSE(root.hasParent());
+    EXPECT_THROW(root.parent(), std::runtime_error);
+    EXPECT_TRUE(viewEqual(&file, root));
+
+    const RecordView objects = *root.find("Objects");
+    EXPECT_EQ(std::string(objects.name()), "Objects");
+    EXPECT_EQ(root.find("Missing"), root.end());
+    const RecordView geometry = *objects.find("Geometry");
+    EXPECT_EQ(geometry.properties().front().get<int64_t>(), 879638976);
+    const Span<const double> vertices = (*geometry.find("Vertices")).properties()[0].getArray<double>();
+    EXPECT_EQ(vertices.size(), 24U);
+    EXPECT_THROW((*geometry.find("Vertices")).properties()[0].getArray<float>(), std::runtime_error);
+    EXPECT_THROW(geometry.properties()[100], std::runtime_error);
+    EXPECT_EQ(std::string(root.front().name()), file.front()->name().c_str());
+    EXPECT_EQ(std::string(root.back().name()), file.back()->name().c_str());
+
+    // Deferred arrays are stored decoded, giving the same snapshot.
+    ReadOptions options;
+    options.deferArrays = true;
+    Record deferred;
+    EXPECT_NO_THROW(deferred.read("../models/blender-default.fbx", options));
+    EXPECT_NO_THROW(deferred.writeSnapshot("../bin/blender-default-deferred.snapshot"));
+    std::ifstream first("../bin/blender-default.snapshot", std::ios::binary);
+    std::ifstream second("../bin/blender-default-deferred.snapshot", std::ios::binary);
+    const std::string firstBytes((std::istreambuf_iterator<char>(first)), std::istreambuf_iterator<char>());
+    const std::string secondBytes((std::istreambuf_iterator<char>(second)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(firstBytes, secondBytes);
+    EXPECT_EQ(firstBytes.size(), snapshot.size());
+
+    // Snapshots are relocatable, any aligned copy can be viewed in place.
+    std::vector<uint64_t> storage((firstBytes.size() + 7) / 8 + 8);
+    uint64_t * buffer = storage.data() + (64 - reinterpret_cast<uintptr_t>(storage.data()) % 64) % 64 / 8;
+    memcpy(buffer, firstBytes.data(), firstBytes.size());
+    Snapshot copy(buffer, firstBytes.size());
+    EXPECT_TRUE(viewEqual(&file, copy.root()));
+
+    EXPECT_THROW(copy.open(buffer, firstBytes.size() - 1), std::runtime_error);
+    EXPECT_THROW(copy.open(reinterpret_cast<const uint8_t *>(buffer) + 1, firstBytes.size() - 8), std::runtime_error);
+    buffer[0] ^= 1;
+    EXPECT_THROW(copy.open(buffer, firstBytes.size()), std::runtime_error);
+    EXPECT_FALSE(copy.isOpen());
+    EXPECT_THROW(copy.open("../models/blender-default.fbx"), std::runtime_error);
+
+    // Budgeted documents page their arrays in one at a time while the snapshot is written.
+    Record large;
+    for (int i = 0; i < 8; i++)
+    {
+        std::vector<double> values(10000);
+        for (size_t j = 0; j < values.size(); j++)
+        {
+            values[j] = static_cast<double>(i * 100000 + j);
+        }
+        (new Record("Array", &large))->properties().insert(new Property(values.data(), static_cast<uint32_t>(values.size())));
+    }
+    EXPECT_NO_THROW(large.write("../bin/snapshot-budget.fbx"));
+    options.deferArrays = false;
+    options.memoryBudget = 100000;
+    Record budgeted;
+    EXPECT_NO_THROW(budgeted.read("../bin/snapshot-budget.fbx", options));
+    EXPECT_TRUE(budgeted.front()->properties().front()->isPaged());
+    EXPECT_NO_THROW(budgeted.writeSnapshot("../bin/snapshot-budget.snapshot"));
+    const Snapshot budgetedSnapshot("../bin/snapshot-budget.snapshot");
+    EXPECT_TRUE(viewEqual(&large, budgetedSnapshot.root()));
+}
+
+TEST(Record, Trace)
+{
+#if defined(FBX_ENABLE_TRACE)
+    startTrace();
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(file.write("../bin/trace-test.fbx"));
+    EXPECT_NO_THROW(stopTrace("../bin/trace-test.json"));
+
+    std::ifstream stream("../bin/trace-test.json");
+    const std::string trace((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(trace.find("{\"traceEvents\":["), 0U);
+    EXPECT_NE(trace.find("\"name\":\"read\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"parse\""), std::string::npos);
+    EXPECT_NE(trace.find("\"detail\":\"Objects\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"inflate\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\":\"deflate\""), std::string::npos);
+#else
+    EXPECT_THROW(startTrace(), std::runtime_error);
+    EXPECT_THROW(stopTrace("../bin/trace-test.json"), std::runtime_error);
+#endif
+}
+
+TEST(Record, DocumentCache)
+{
+    Record file;
+    EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+    EXPECT_NO_THROW(file.write("../bin/cache-first.fbx"));
+    EXPECT_NO_THROW(file.write("../bin/cache-second.fbx"));
+
+    // Concurrent loads of one file parse it once and share the document.
+    std::atomic<int> parses(0);
+    ReadOptions options;
+    options.onHeaderRead = [&parses](std::string, uint32_t) { ++parses; };
+    DocumentCache cache(static_cast<size_t>(1) << 30, options);
+    std::vector<std::shared_ptr<const Document>> documents(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < documents.size(); i++)
+    {
+        threads.emplace_back([&cache, &documents, i]() { documents[i] = cache.load("../bin/cache-first.fbx"); });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(parses.load(), 1);
+    ASSERT_TRUE(documents[0] != nullptr);
+    for (auto & document : documents)
+    {
+        EXPECT_EQ(document, documents[0]);
+    }
+    EXPECT_EQ(cache.size(), 1U);
+    EXPECT_EQ(cache.memoryUsage(), documents[0]->memoryUsage());
+    EXPECT_NE(documents[0]->root().find("Objects"), documents[0]->root().end());
+
+    // A changed file is parsed again.
+    new Record("Extra", &file);
+    EXPECT_NO_THROW(file.write("../bin/cache-first.fbx"));
+    const std::shared_ptr<const Document> changed = cache.load("../bin/cache-first.fbx");
+    EXPECT_NE(changed, documents[0]);
+    EXPECT_EQ(parses.load(), 2);
+    EXPECT_EQ(cache.load("../bin/cache-first.fbx"), changed);
+    EXPECT_EQ(cache.size(), 1U);
+
+    // The budget keeps the most recently used document, earlier handles stay valid.
+    DocumentCache small(changed->memoryUsage(), options);
+    const std::shared_ptr<const Document> first = small.load("../bin/cache-first.fbx");
+    const std::shared_ptr<const Document> second = small.load("../bin/cache-second.fbx");
+    EXPECT_EQ(small.size(), 1U);
+    EXPECT_LE(small.memoryUsage(), small.capacity());
+    EXPECT_NE(first->root().find("Extra"), first->root().end());
+    EXPECT_NE(small.load("../bin/cache-first.fbx"), first);
+    small.clear();
+    EXPECT_EQ(small.size(), 0U);
+    EXPECT_EQ(small.memoryUsage(), 0U);
+
+    // Loads report their own statistics, the shared statistics object is left alone.
+    Statistics shared;
+    std::atomic<int> reports(0);
+    ReadOptions deferred;
+    deferred.deferArrays = true;
+    deferred.statistics = &shared;
+    deferred.onStatistics = [&reports](const Statistics & statistics) { reports += statistics.bytesRead == 25814 ? 1 : 0; };
+    const size_t deferredUsage = Document("../bin/cache-second.fbx", deferred).memoryUsage();
+    shared = Statistics();
+    reports = 0;
+    DocumentCache growing(deferredUsage + 64, deferred);
+    const std::shared_ptr<const Document> lazy = growing.load("../bin/cache-second.fbx");
+    EXPECT_EQ(reports.load(), 1);
+    EXPECT_EQ(shared.bytesRead, 0U);
+    EXPECT_EQ(growing.size(), 1U);
+
+    // Arrays inflated after loading count against the capacity.
+    const Property * pVertices = (*(*(*lazy->root().find("Objects"))->find("Geometry"))->find("Vertices"))->properties().front();
+    lazy->getArray<double>(*pVertices);
+    EXPECT_EQ(growing.memoryUsage(), lazy->memoryUsage());
+    EXPECT_GT(growing.memoryUsage(), growing.capacity());
+    EXPECT_EQ(growing.load("../bin/cache-second.fbx"), lazy);
+    EXPECT_EQ(growing.size(), 0U);
+
+    // Failed loads are not cached.
+    EXPECT_THROW(cache.load("../bin/cache-missing.fbx"), std::runtime_error);
+    std::ifstream source("../models/blender-default.fbx", std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    std::ofstream("../bin/cache-invalid.fbx", std::ios::binary) << bytes.substr(0, 1000);
+    EXPECT_THROW(cache.load("../bin/cache-invalid.fbx"), std::runtime_error);
+    EXPECT_THROW(cache.load("../bin/cache-invalid.fbx"), std::runtime_error);
+    EXPECT_EQ(cache.size(), 1U);
+}
+
+TEST(Record, Document)
+{
+    Record eager;
+    EXPECT_NO_THROW(eager.read("../models/blender-default.fbx"));
+    const Property * pExpected = (*(*(*eager.find("Objects"))->find("Geometry"))->find("Vertices"))->properties().front();
+    const Span<const double> expected = pExpected->getArray<double>();
+
+    // Encoded arrays are inflated once, whichever reader gets there first.
+    ReadOptions options;
+    options.deferArrays = true;
+    const Document document("../models/blender-default.fbx", options);
+    const Property * pVertices = (*(*(*document.root().find("Objects"))->find("Geometry"))->find("Vertices"))->properties().front();
+    ASSERT_TRUE(pVertices->isEncoded());
+    const size_t usage = document.memoryUsage();
+    std::vector<const double *> arrays(8, nullptr);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < arrays.size(); i++)
+    {
+        threads.emplace_back([&document, &arrays, pVertices, i]() { arrays[i] = document.getArray<double>(*pVertices).data(); });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    for (auto & array : arrays)
+    {
+        EXPECT_EQ(array, arrays[0]);
+    }
+    const Span<const double> vertices = document.getArray<double>(*pVertices);
+    ASSERT_EQ(vertices.size(), expected.size());
+    EXPECT_TRUE(std::equal(vertices.begin(), vertices.end(), expected.begin()));
+    EXPECT_EQ(document.array(*pVertices)[3].float64, expected[3]);
+    EXPECT_EQ(document.memoryUsage(), usage + expected.size() * sizeof(double));
+    EXPECT_THROW(document.getArray<float>(*pVertices), std::runtime_error);
+    Record foreign;
+    EXPECT_NO_THROW(foreign.read("../models/blender-default.fbx", options));
+    EXPECT_THROW(document.data(*(*(*(*foreign.find("Objects"))->find("Geometry"))->find("Vertices"))->properties().front()), std::runtime_error);
+
+    // Paged arrays are made resident.
+    options.deferArrays = false;
+    options.memoryBudget = 1;
+    const Document paged("../models/blender-default.fbx", options);
+    const Property * pPaged = (*(*(*paged.root().find("Objects"))->find("Geometry"))->find("Vertices"))->properties().front();
+    EXPECT_FALSE(pPaged->isPaged());
+    EXPECT_EQ(paged.getArray<double>(*pPaged)[5], expected[5]);
+
+    Record * pRoot = new Record;
+    Record * pChild = new Record("Child", pRoot);
+    EXPECT_THROW(Document document(pChild), std::runtime_error);
+    const Document owned(pRoot);
+    EXPECT_EQ(owned.root().size(), 1U);
+}
+
 TEST(Record, ReaderWriter)
 {
     Record file1;
@@ -163,6 +1759,56 @@ TEST(Record, ReaderWriter)
     EXPECT_NO_THROW(file2.read("../bin/blender-default-test.fbx"));
 }
 
+TEST(Record, MemoryResource)
+{
+    class CountingResource : public MemoryResource
+    {
+
+    public:
+
+        CountingResource() :
+            allocations(0),
+            bytes(0)
+        {}
+
+        void * allocate(const size_t size, const size_t) override
+        {
+            ++allocations;
+            bytes += size;
+            return ::operator new(size);
+        }
+
+        void deallocate(void * pointer, const size_t size, const size_t) override
+        {
+            bytes -= size;
+            ::operator delete(pointer);
+        }
+
+        size_t allocations;
+        size_t bytes;
+
+    };
+
+    CountingResource resource;
+    {
+        Record file(&resource);
+        EXPECT_NO_THROW(file.read("../models/blender-default.fbx"));
+        EXPECT_GT(resource.allocations, 0);
+        EXPECT_GT(resource.bytes, 0);
+
+        auto objects = *file.find("Objects");
+        EXPECT_EQ(objects->resource(), &resource);
+        EXPECT_EQ(objects->properties().resource(), &resource);
+        EXPECT_EQ((*objects->find("Geometry"))->properties().front()->resource(), &resource);
+
+        Record * pCustom = new (&resource) Record("Custom", &file);
+        EXPECT_EQ(pCustom->resource(), &resource);
+        pCustom->properties().insert(new Property(std::string("Global heap property")));
+        EXPECT_EQ(pCustom->properties().front()->resource(), MemoryResource::defaultResource());
+    }
+    EXPECT_EQ(resource.bytes, 0);
+}
+
 int main(int argc, char ** argv)
 {
 	testing::InitGoogleTest(&argc, argv);